@@ -1,52 +1,385 @@
 /*
     Программа параллельного вычисления числа pi методом средних прямоугольников
-    с использованием MPI.
+    с использованием MPI, и набор замеров коллективных операций.
 
     Компиляция:
-    mpicc -o pi_mpi pi_mpi.c
-    
+    mpicc -O2 -o pi_mpi pi_mpi.c -lm
+
     Запуск:
-    mpirun -np <num_processes> ./pi_mpi <num_iterations> 
+    mpirun -np <num_processes> ./pi_mpi <num_iterations> [--kernel=auto|scalar|avx2|avx512]
+                                        [--sum=naive|repro]
+                                        [--reps=R] [--warmup=W] [--bench-out=FILE]
+    mpirun -np <num_processes> ./pi_mpi --bench [--min-count=C] [--max-count=C]
+                                        [--iters=N] [--overlap-n=N] [--kernel=...]
+
+    Отрезок [0, 1] делится на n прямоугольников блоками: процесс r берёт
+    номера [r·n/P, (r+1)·n/P), так что покрыты все n при любом P.
+    Локальная сумма считается векторным ядром (AVX2 / AVX-512, выбор во
+    время выполнения, --kernel=scalar — прежний скалярный цикл).
+
+    --sum=repro — воспроизводимая сумма: номера делятся на блоки по
+    REPRO_BLOCK, не зависящие от P; процессы берут блоки целиком, сумма
+    блока кладётся в точный сумматор (common/reprosum.h), сумматоры
+    складываются собственной операцией MPI_Op. Результат побитово
+    одинаков при любом числе процессов (для одного и того же ядра).
+
+    --reps/--warmup/--bench-out (common/bench.h): вычисление и MPI_Reduce
+    повторяются R раз после W прогревочных; печатаются медианы, в файл
+    пишутся конфигурация, статистика времени вычисления и хост.
+
+    --bench печатает CSV по числу процессов и размеру (count чисел double,
+    от min до max с шагом ×4):
+
+        op,ranks,count,bytes,iters,min_us,median_us,p99_us
+
+      reduce, allreduce       — MPI_Reduce / MPI_Allreduce (MPI_SUM);
+      tree_reduce             — биномиальное дерево на Send/Recv к корню 0;
+      rd_allreduce            — рекурсивное удвоение на Sendrecv (для P не
+                                степени двойки лишние процессы сначала
+                                сливаются с соседями);
+      compute                 — ядро на overlap-n точках без обмена;
+      ireduce_overlap         — MPI_Ireduce, то же вычисление, MPI_Wait.
+    Время итерации — максимум по процессам. Результаты собственных
+    реализаций сверяются с MPI_Allreduce.
 */
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+#include "../../common/reprosum.h"
+#include "../../common/bench.h"
+
+#define REPRO_BLOCK 4096
 
 static double f(double x) {
     return 4.0 / (1.0 + x * x);
 }
 
+typedef double (*pi_kernel_fn)(long long lo, long long hi, double h);
+
+/* Сумма f(x_i) по i из [lo, hi), x_i = (i + 0.5)·h. */
+static double pi_sum_scalar(long long lo, long long hi, double h) {
+    double sum = 0.0;
+    for (long long i = lo; i < hi; i++) {
+        double x = (i + 0.5) * h;
+        sum += f(x);
+    }
+    return sum;
+}
+
+__attribute__((target("avx2")))
+static double pi_sum_avx2(long long lo, long long hi, double h) {
+    const __m256d vh = _mm256_set1_pd(h), half = _mm256_set1_pd(0.5);
+    const __m256d one = _mm256_set1_pd(1.0), four = _mm256_set1_pd(4.0);
+    const __m256d step = _mm256_set1_pd(8.0);
+    __m256d i0 = _mm256_add_pd(_mm256_set1_pd((double)lo), _mm256_setr_pd(0, 1, 2, 3));
+    __m256d i1 = _mm256_add_pd(i0, _mm256_set1_pd(4.0));
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    long long i = lo;
+    for (; i + 8 <= hi; i += 8) {
+        __m256d x0 = _mm256_mul_pd(_mm256_add_pd(i0, half), vh);
+        __m256d x1 = _mm256_mul_pd(_mm256_add_pd(i1, half), vh);
+        s0 = _mm256_add_pd(s0, _mm256_div_pd(four, _mm256_add_pd(one, _mm256_mul_pd(x0, x0))));
+        s1 = _mm256_add_pd(s1, _mm256_div_pd(four, _mm256_add_pd(one, _mm256_mul_pd(x1, x1))));
+        i0 = _mm256_add_pd(i0, step);
+        i1 = _mm256_add_pd(i1, step);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + pi_sum_scalar(i, hi, h);
+}
+
+__attribute__((target("avx512f")))
+static double pi_sum_avx512(long long lo, long long hi, double h) {
+    const __m512d vh = _mm512_set1_pd(h), half = _mm512_set1_pd(0.5);
+    const __m512d one = _mm512_set1_pd(1.0), four = _mm512_set1_pd(4.0);
+    const __m512d step = _mm512_set1_pd(16.0);
+    __m512d i0 = _mm512_add_pd(_mm512_set1_pd((double)lo),
+                               _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7));
+    __m512d i1 = _mm512_add_pd(i0, _mm512_set1_pd(8.0));
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    long long i = lo;
+    for (; i + 16 <= hi; i += 16) {
+        __m512d x0 = _mm512_mul_pd(_mm512_add_pd(i0, half), vh);
+        __m512d x1 = _mm512_mul_pd(_mm512_add_pd(i1, half), vh);
+        s0 = _mm512_add_pd(s0, _mm512_div_pd(four, _mm512_add_pd(one, _mm512_mul_pd(x0, x0))));
+        s1 = _mm512_add_pd(s1, _mm512_div_pd(four, _mm512_add_pd(one, _mm512_mul_pd(x1, x1))));
+        i0 = _mm512_add_pd(i0, step);
+        i1 = _mm512_add_pd(i1, step);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(s0, s1)) + pi_sum_scalar(i, hi, h);
+}
+
+static pi_kernel_fn pi_kernel_select(const char *name, const char **chosen) {
+    __builtin_cpu_init();
+    int auto_sel = (strcmp(name, "auto") == 0);
+    if ((auto_sel || strcmp(name, "avx512") == 0) && __builtin_cpu_supports("avx512f")) {
+        *chosen = "avx512";
+        return pi_sum_avx512;
+    }
+    if ((auto_sel || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        *chosen = "avx2";
+        return pi_sum_avx2;
+    }
+    if (auto_sel || strcmp(name, "scalar") == 0) {
+        *chosen = "scalar";
+        return pi_sum_scalar;
+    }
+    return NULL;
+}
+
+/* Границы блока процесса rank: [n·rank/size, n·(rank+1)/size) без переполнения. */
+static long long block_start(long long n, int rank, int size) {
+    return (n / size) * rank + (n % size) * rank / size;
+}
+
+/* Биномиальное дерево: после вызова buf на процессе 0 содержит сумму. */
+static void tree_reduce(double *buf, double *tmp, int count, int rank, int size) {
+    for (int mask = 1; mask < size; mask <<= 1) {
+        if (rank & mask) {
+            MPI_Send(buf, count, MPI_DOUBLE, rank - mask, 10, MPI_COMM_WORLD);
+            break;
+        }
+        if (rank + mask < size) {
+            MPI_Recv(tmp, count, MPI_DOUBLE, rank + mask, 10, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            for (int i = 0; i < count; ++i) buf[i] += tmp[i];
+        }
+    }
+}
+
+/* Рекурсивное удвоение: после вызова buf на всех процессах содержит сумму. */
+static void rd_allreduce(double *buf, double *tmp, int count, int rank, int size) {
+    int pof2 = 1;
+    while (pof2 * 2 <= size) pof2 *= 2;
+    int rem = size - pof2;
+    int newrank;
+    /* Первые 2·rem процессов сливаются попарно: чётные отдают данные нечётным. */
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            MPI_Send(buf, count, MPI_DOUBLE, rank + 1, 11, MPI_COMM_WORLD);
+            newrank = -1;
+        } else {
+            MPI_Recv(tmp, count, MPI_DOUBLE, rank - 1, 11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            for (int i = 0; i < count; ++i) buf[i] += tmp[i];
+            newrank = rank / 2;
+        }
+    } else {
+        newrank = rank - rem;
+    }
+    if (newrank >= 0) {
+        for (int mask = 1; mask < pof2; mask <<= 1) {
+            int np = newrank ^ mask;
+            int partner = np < rem ? 2 * np + 1 : np + rem;
+            MPI_Sendrecv(buf, count, MPI_DOUBLE, partner, 12, tmp, count, MPI_DOUBLE, partner, 12,
+                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            for (int i = 0; i < count; ++i) buf[i] += tmp[i];
+        }
+    }
+    if (rank < 2 * rem) {
+        if (rank % 2) MPI_Send(buf, count, MPI_DOUBLE, rank - 1, 13, MPI_COMM_WORLD);
+        else          MPI_Recv(buf, count, MPI_DOUBLE, rank + 1, 13, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+enum { OP_REDUCE, OP_ALLREDUCE, OP_TREE, OP_RD, OP_COMPUTE, OP_IREDUCE, OP_COUNT };
+static const char *op_names[] = {
+    "reduce", "allreduce", "tree_reduce", "rd_allreduce", "compute", "ireduce_overlap"
+};
+
+static void bench_collectives(int rank, int size, int min_count, int max_count, int iters,
+                  long long overlap_n, pi_kernel_fn kern) {
+    double *sbuf = malloc(max_count * sizeof(double));
+    double *rbuf = malloc(max_count * sizeof(double));
+    double *tmp  = malloc(max_count * sizeof(double));
+    double *ref  = malloc(max_count * sizeof(double));
+    double *tloc = malloc(iters * sizeof(double));
+    double *tmax = malloc(iters * sizeof(double));
+    if (!sbuf || !rbuf || !tmp || !ref || !tloc || !tmax) {
+        fprintf(stderr, "Ошибка: не удалось выделить буферы.\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    double h = 1.0 / (double)(overlap_n * size);
+    long long lo = overlap_n * rank, hi = lo + overlap_n;
+    volatile double sink = 0.0;
+
+    if (rank == 0) printf("op,ranks,count,bytes,iters,min_us,median_us,p99_us\n");
+    int warmup = iters / 10 > 2 ? iters / 10 : 2;
+    for (int count = min_count; count <= max_count; count *= 4) {
+        /* Целые значения: любая расстановка скобок даёт точно ту же сумму. */
+        for (int i = 0; i < count; ++i) sbuf[i] = (double)(rank + i % 7);
+        MPI_Allreduce(sbuf, ref, count, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+        for (int op = 0; op < OP_COUNT; ++op) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            for (int it = -warmup; it < iters; ++it) {
+                MPI_Request req;
+                double t0 = MPI_Wtime();
+                switch (op) {
+                case OP_REDUCE:
+                    MPI_Reduce(sbuf, rbuf, count, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+                    break;
+                case OP_ALLREDUCE:
+                    MPI_Allreduce(sbuf, rbuf, count, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                    break;
+                case OP_TREE:
+                    memcpy(rbuf, sbuf, count * sizeof(double));
+                    tree_reduce(rbuf, tmp, count, rank, size);
+                    break;
+                case OP_RD:
+                    memcpy(rbuf, sbuf, count * sizeof(double));
+                    rd_allreduce(rbuf, tmp, count, rank, size);
+                    break;
+                case OP_COMPUTE:
+                    sink = kern(lo, hi, h);
+                    break;
+                case OP_IREDUCE:
+                    MPI_Ireduce(sbuf, rbuf, count, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD, &req);
+                    sink = kern(lo, hi, h);
+                    MPI_Wait(&req, MPI_STATUS_IGNORE);
+                    break;
+                }
+                if (it >= 0) tloc[it] = MPI_Wtime() - t0;
+            }
+            int check_all = (op == OP_ALLREDUCE || op == OP_RD);
+            int check_root = (op == OP_REDUCE || op == OP_TREE || op == OP_IREDUCE);
+            if ((check_all || (check_root && rank == 0)) &&
+                memcmp(rbuf, ref, count * sizeof(double)) != 0) {
+                fprintf(stderr, "Ошибка: %s дал неверную сумму (count=%d).\n", op_names[op], count);
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+            MPI_Reduce(tloc, tmax, iters, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+            if (rank == 0) {
+                qsort(tmax, iters, sizeof(double), cmp_double);
+                double med = (iters % 2) ? tmax[iters / 2]
+                                         : 0.5 * (tmax[iters / 2 - 1] + tmax[iters / 2]);
+                double p99 = tmax[(int)(0.99 * (iters - 1) + 0.5)];
+                printf("%s,%d,%d,%ld,%d,%.3f,%.3f,%.3f\n", op_names[op], size, count,
+                       (long)count * (long)sizeof(double), iters,
+                       tmax[0] * 1e6, med * 1e6, p99 * 1e6);
+            }
+        }
+    }
+    (void)sink;
+    free(sbuf); free(rbuf); free(tmp); free(ref); free(tloc); free(tmax);
+}
+
 int main(int argc, char *argv[]) {
     int rank, size;
+    bench_t bench, reduce_bench;
+    bench_init(&bench, "pi_mpi", &argc, argv);
+    reduce_bench = bench;
+    reduce_bench.out = NULL;
     long long n = 1000000;
-    if (argc >= 2) {
-        n = atoll(argv[1]);
+    const char *kernel_name = "auto";
+    int repro = 0;
+    int do_bench = 0, min_count = 1, max_count = 1 << 20, iters = 200;
+    long long overlap_n = 1 << 18;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--kernel=", 9) == 0)          kernel_name = argv[i] + 9;
+        else if (strcmp(argv[i], "--bench") == 0)           do_bench = 1;
+        else if (strcmp(argv[i], "--sum=repro") == 0)       repro = 1;
+        else if (strcmp(argv[i], "--sum=naive") == 0)       repro = 0;
+        else if (strncmp(argv[i], "--min-count=", 12) == 0) min_count = atoi(argv[i] + 12);
+        else if (strncmp(argv[i], "--max-count=", 12) == 0) max_count = atoi(argv[i] + 12);
+        else if (strncmp(argv[i], "--iters=", 8) == 0)      iters = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--overlap-n=", 12) == 0) overlap_n = atoll(argv[i] + 12);
+        else n = atoll(argv[i]);
     }
 
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    long long local_n = n / size;
-    double h = 1.0 / (double)n;
-    double local_a = rank * local_n * h;
+    const char *kernel_used = NULL;
+    pi_kernel_fn kern = pi_kernel_select(kernel_name, &kernel_used);
+    const char *err = NULL;
+    if (!kern) err = "ядро недоступно на этом процессоре";
+    else if (n < 1) err = "число итераций должно быть положительным";
+    else if (do_bench && (min_count < 1 || max_count < min_count || iters < 1 || overlap_n < 1))
+        err = "некорректные параметры --bench";
+    if (err) {
+        if (rank == 0) fprintf(stderr, "Ошибка: %s.\n", err);
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
 
-    double local_sum = 0.0;
-    for (long long i = 0; i < local_n; i++) {
-        double x = local_a + (i + 0.5) * h;
-        local_sum += f(x);
+    if (do_bench) {
+        bench_collectives(rank, size, min_count, max_count, iters, overlap_n, kern);
+        MPI_Finalize();
+        return 0;
     }
-    local_sum *= h;
 
-    double pi = 0.0;
-    MPI_Reduce(&local_sum, &pi, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    bench_config(&bench, "n", "%lld", n);
+    bench_config(&bench, "kernel", "%s", kernel_used);
+    bench_config(&bench, "sum", "%s", repro ? "repro" : "naive");
+
+    double h = 1.0 / (double)n;
+    double pi = 0.0, t0, t1, t2;
+    MPI_Datatype rs_type;
+    MPI_Op rs_op;
+    if (repro) reprosum_mpi_init(&rs_type, &rs_op);
+
+    for (int r = 0; r < bench_runs(&bench); ++r) {
+        if (repro) {
+            long long nblocks = (n + REPRO_BLOCK - 1) / REPRO_BLOCK;
+            long long b_lo = block_start(nblocks, rank, size);
+            long long b_hi = block_start(nblocks, rank + 1, size);
+            reprosum_t local, total;
+            reprosum_init(&local);
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            t0 = MPI_Wtime();
+            for (long long b = b_lo; b < b_hi; ++b) {
+                long long lo = b * REPRO_BLOCK;
+                long long hi = lo + REPRO_BLOCK < n ? lo + REPRO_BLOCK : n;
+                reprosum_add(&local, kern(lo, hi, h));
+            }
+            t1 = MPI_Wtime();
+            MPI_Reduce(&local, &total, 1, rs_type, rs_op, 0, MPI_COMM_WORLD);
+            t2 = MPI_Wtime();
+            if (rank == 0) pi = reprosum_value(&total) * h;
+        } else {
+            long long lo = block_start(n, rank, size);
+            long long hi = block_start(n, rank + 1, size);
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            t0 = MPI_Wtime();
+            double local_sum = kern(lo, hi, h) * h;
+            t1 = MPI_Wtime();
+            MPI_Reduce(&local_sum, &pi, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+            t2 = MPI_Wtime();
+        }
+
+        double t_compute = t1 - t0, t_compute_max;
+        MPI_Allreduce(&t_compute, &t_compute_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        bench_record(&bench, r, t_compute_max);
+        bench_record(&reduce_bench, r, t2 - t1);
+    }
+    if (repro) {
+        MPI_Op_free(&rs_op);
+        MPI_Type_free(&rs_type);
+    }
 
     if (rank == 0) {
         printf("Число процессов: %d\n", size);
         printf("Количество итераций: %lld\n", n);
-        printf("Вычисленное pi = %.16f\n", pi);
+        printf("Ядро: %s, суммирование: %s\n", kernel_used, repro ? "repro" : "naive");
+        printf("Вычисленное pi = %.16f (погрешность %.3e)\n", pi, fabs(pi - M_PI));
+        printf("Время вычисления (макс. по процессам): %.6f с, время MPI_Reduce: %.6f с\n",
+               bench_median(&bench), bench_median(&reduce_bench));
+        bench_metric(&bench, "reduce_time", bench_median(&reduce_bench));
+        bench_metric(&bench, "pi_error", fabs(pi - M_PI));
     }
+    bench_finish(&bench);
+    free(reduce_bench.samples);
 
     MPI_Finalize();
     return 0;
@@ -0,0 +1,25 @@
+#!/bin/bash
+set -e
+
+# Замеры коллективных операций pi_mpi --bench для разного числа процессов
+# Генерирует collectives.csv с полями: op,ranks,count,bytes,iters,min_us,median_us,p99_us
+
+mpicc -O2 -o pi_mpi pi_mpi.c -lm
+
+# Число процессов
+Ps=(2 3 4 8 16)
+# Диапазон размеров (число double) и число повторов
+MIN_COUNT=${MIN_COUNT:-1}
+MAX_COUNT=${MAX_COUNT:-1048576}
+ITERS=${ITERS:-200}
+
+first=1
+for P in "${Ps[@]}"; do
+  echo "Collectives: P=$P"
+  if [ $first -eq 1 ]; then
+    mpirun -np $P ./pi_mpi --bench --min-count=$MIN_COUNT --max-count=$MAX_COUNT --iters=$ITERS > collectives.csv
+    first=0
+  else
+    mpirun -np $P ./pi_mpi --bench --min-count=$MIN_COUNT --max-count=$MAX_COUNT --iters=$ITERS | tail -n +2 >> collectives.csv
+  fi
+done
@@ -1,38 +1,276 @@
 /*
-    Программа измерения времени коммуникации между двумя узлами (ping-pong).
+    Программа измерения времени коммуникации между узлами (ping-pong)
+    и набор тестов латентности/пропускной способности.
 
     Компиляция:
-    mpicc -o ping_pong ping_pong.c
+    mpicc -O2 -o ping_pong ping_pong.c -lm
     Запуск:
-    mpirun -np 2 ./ping_pong [message_size_bytes] [iterations] 
+    mpirun -np 2 ./ping_pong [message_size_bytes] [iterations] [--warmup=W]
+                             [--bench-out=FILE]
+    mpirun -np P ./ping_pong --sweep [--mode=pingpong,stream,bidir,allpairs]
+                             [--min=BYTES] [--max=BYTES] [--iters=N]
+                             [--window=W] [--csv=FILE]
+
+    Без --sweep — прежний режим: один размер, оборот 0 <-> 1, теперь
+    с прогревом и с минимумом/медианой/99-м процентилем. Каждый оборот —
+    отдельный замер common/bench.h: --bench-out пишет конфигурацию,
+    медиану, IQR и доверительный интервал; --warmup задаёт прогрев
+    (по умолчанию iterations/10, не меньше 2).
+
+    --sweep перебирает размеры min, 2·min, ... до max (по умолчанию
+    от 1 Б до 64 МиБ; так захватываются и eager-, и rendezvous-сообщения,
+    переход виден как ступенька на кривой) и печатает CSV:
+
+        mode,bytes,iters,window,min_us,median_us,p99_us,gbps
+
+    Режимы:
+      pingpong — Send/Recv туда и обратно между 0 и 1; время — половина
+                 оборота, GB/s — bytes / медиана.
+      stream   — 0 отправляет окно из W Isend, 1 принимает W Irecv и
+                 подтверждает пустым сообщением; время — окно / W.
+      bidir    — то же в обе стороны одновременно, GB/s считаются по
+                 байтам обоих направлений.
+      allpairs — все P процессов: за итерацию P-1 шагов Sendrecv со
+                 сдвигом s; время — максимум по процессам, GB/s —
+                 суммарный объём всех процессов.
+
+    Каждая итерация измеряется отдельно (иначе не получить процентили);
+    перед замером выполняется прогрев. Для больших сообщений число
+    итераций уменьшается пропорционально размеру, а окно — так, чтобы
+    буфер окна занимал не больше WINDOW_BYTES (64 МиБ).
 */
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "../../common/bench.h"
+
+#define WINDOW_BYTES (64L << 20)
+
+enum { MODE_PINGPONG = 1, MODE_STREAM = 2, MODE_BIDIR = 4, MODE_ALLPAIRS = 8 };
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Сортирует t[0..n) и возвращает минимум, медиану и 99-й процентиль. */
+static void stats(double *t, int n, double *tmin, double *tmed, double *tp99) {
+    qsort(t, n, sizeof(double), cmp_double);
+    *tmin = t[0];
+    *tmed = (n % 2) ? t[n / 2] : 0.5 * (t[n / 2 - 1] + t[n / 2]);
+    int k = (int)(0.99 * (n - 1) + 0.5);
+    *tp99 = t[k];
+}
+
+/* Время половины оборота 0 <-> 1 для каждой итерации (на процессе 0). */
+static void run_pingpong(char *buf, int bytes, int warmup, int iters, double *t, int rank) {
+    for (int i = -warmup; i < iters; ++i) {
+        if (rank == 0) {
+            double t0 = MPI_Wtime();
+            MPI_Send(buf, bytes, MPI_CHAR, 1, 0, MPI_COMM_WORLD);
+            MPI_Recv(buf, bytes, MPI_CHAR, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            double t1 = MPI_Wtime();
+            if (i >= 0) t[i] = 0.5 * (t1 - t0);
+        } else if (rank == 1) {
+            MPI_Recv(buf, bytes, MPI_CHAR, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Send(buf, bytes, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
+        }
+    }
+}
+
+/*
+ * Окно из window сообщений от 0 к 1 (bidir — и от 1 к 0), затем
+ * подтверждение. t[i] — время окна на процессе 0.
+ */
+static void run_window(char *sbuf, char *rbuf, int bytes, int window, int bidir,
+                       int warmup, int iters, double *t, int rank, MPI_Request *req) {
+    if (rank > 1) return;
+    int peer = 1 - rank;
+    for (int i = -warmup; i < iters; ++i) {
+        double t0 = MPI_Wtime();
+        int nreq = 0;
+        if (rank == 1 || bidir)
+            for (int w = 0; w < window; ++w)
+                MPI_Irecv(rbuf + (long)w * bytes, bytes, MPI_CHAR, peer, 1, MPI_COMM_WORLD, &req[nreq++]);
+        if (rank == 0 || bidir)
+            for (int w = 0; w < window; ++w)
+                MPI_Isend(sbuf + (long)w * bytes, bytes, MPI_CHAR, peer, 1, MPI_COMM_WORLD, &req[nreq++]);
+        MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE);
+        if (rank == 1) MPI_Send(NULL, 0, MPI_CHAR, 0, 2, MPI_COMM_WORLD);
+        else           MPI_Recv(NULL, 0, MPI_CHAR, 1, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        if (rank == 0 && i >= 0) t[i] = MPI_Wtime() - t0;
+    }
+}
+
+/* Полный обмен со сдвигами; t[i] — максимум по процессам (на процессе 0). */
+static void run_allpairs(char *sbuf, char *rbuf, int bytes, int warmup, int iters,
+                         double *t, double *tloc, int rank, int size) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    for (int i = -warmup; i < iters; ++i) {
+        double t0 = MPI_Wtime();
+        for (int s = 1; s < size; ++s) {
+            int dst = (rank + s) % size, src = (rank - s + size) % size;
+            MPI_Sendrecv(sbuf, bytes, MPI_CHAR, dst, 3, rbuf, bytes, MPI_CHAR, src, 3,
+                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+        if (i >= 0) tloc[i] = MPI_Wtime() - t0;
+    }
+    MPI_Reduce(tloc, t, iters, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+}
+
+static int parse_modes(const char *s) {
+    int m = 0;
+    char tmp[128];
+    strncpy(tmp, s, sizeof(tmp) - 1);
+    tmp[sizeof(tmp) - 1] = '\0';
+    for (char *tok = strtok(tmp, ","); tok; tok = strtok(NULL, ",")) {
+        if      (strcmp(tok, "pingpong") == 0) m |= MODE_PINGPONG;
+        else if (strcmp(tok, "stream") == 0)   m |= MODE_STREAM;
+        else if (strcmp(tok, "bidir") == 0)    m |= MODE_BIDIR;
+        else if (strcmp(tok, "allpairs") == 0) m |= MODE_ALLPAIRS;
+        else if (strcmp(tok, "all") == 0)      m |= MODE_PINGPONG | MODE_STREAM | MODE_BIDIR | MODE_ALLPAIRS;
+        else return -1;
+    }
+    return m;
+}
+
+static void sweep(int rank, int size, int modes, long min_bytes, long max_bytes,
+                 int base_iters, int max_window, const char *csv_path) {
+    FILE *out = stdout;
+    if (rank == 0 && csv_path) {
+        out = fopen(csv_path, "w");
+        if (!out) {
+            fprintf(stderr, "Ошибка: не удалось открыть %s\n", csv_path);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+    /* Буфер окна: W сообщений максимального размера, но не больше WINDOW_BYTES. */
+    long cap = (long)max_window * (max_bytes > 0 ? max_bytes : 1);
+    if (cap > WINDOW_BYTES) cap = WINDOW_BYTES;
+    if (cap < max_bytes) cap = max_bytes;
+    char *sbuf = malloc(cap), *rbuf = malloc(cap);
+    double *t = malloc(base_iters * sizeof(double));
+    double *tloc = malloc(base_iters * sizeof(double));
+    MPI_Request *req = malloc(2 * max_window * sizeof(MPI_Request));
+    if (!sbuf || !rbuf || !t || !tloc || !req) {
+        fprintf(stderr, "Ошибка: не удалось выделить буферы (%ld байт)\n", cap);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    memset(sbuf, rank, cap);
+    memset(rbuf, 0, cap);
+
+    if (rank == 0) fprintf(out, "mode,bytes,iters,window,min_us,median_us,p99_us,gbps\n");
+
+    static const struct { int flag; const char *name; } mode_list[] = {
+        {MODE_PINGPONG, "pingpong"}, {MODE_STREAM, "stream"},
+        {MODE_BIDIR, "bidir"}, {MODE_ALLPAIRS, "allpairs"},
+    };
+    for (int mi = 0; mi < 4; ++mi) {
+        int m = mode_list[mi].flag;
+        if (!(modes & m)) continue;
+        for (long bytes = min_bytes; bytes <= max_bytes; bytes = bytes ? 2 * bytes : 1) {
+            /* Примерно base_iters·64 КиБ данных на размер, не меньше 10 итераций. */
+            long scaled = bytes > 65536 ? (long)base_iters * 65536 / bytes : base_iters;
+            int iters = scaled < 10 ? 10 : (int)scaled;
+            int warmup = iters / 10 > 2 ? iters / 10 : 2;
+            int window = 1;
+            if (m == MODE_STREAM || m == MODE_BIDIR) {
+                long w = bytes ? cap / bytes : max_window;
+                window = w < 1 ? 1 : (w > max_window ? max_window : (int)w);
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+            double moved;
+            if (m == MODE_PINGPONG) {
+                run_pingpong(sbuf, (int)bytes, warmup, iters, t, rank);
+                moved = (double)bytes;
+            } else if (m == MODE_ALLPAIRS) {
+                run_allpairs(sbuf, rbuf, (int)bytes, warmup, iters, t, tloc, rank, size);
+                moved = (double)bytes * size * (size - 1);
+            } else {
+                int bidir = (m == MODE_BIDIR);
+                run_window(sbuf, rbuf, (int)bytes, window, bidir, warmup, iters, t, rank, req);
+                moved = (double)bytes * window * (bidir ? 2 : 1);
+            }
+            if (rank == 0) {
+                double tmin, tmed, tp99;
+                stats(t, iters, &tmin, &tmed, &tp99);
+                double gbps = moved / tmed * 1e-9;
+                fprintf(out, "%s,%ld,%d,%d,%.3f,%.3f,%.3f,%.4f\n", mode_list[mi].name,
+                        bytes, iters, window, tmin / window * 1e6, tmed / window * 1e6,
+                        tp99 / window * 1e6, gbps);
+                fflush(out);
+            }
+        }
+    }
+
+    if (rank == 0 && out != stdout) fclose(out);
+    free(sbuf); free(rbuf); free(t); free(tloc); free(req);
+}
 
 int main(int argc, char *argv[]) {
     int rank, size;
-    double t_start, t_end, total_time = 0.0;
-    int tag = 0;
-    int message_size = 1;      
-    int iterations = 10000;    
-
-    if (argc >= 2) message_size = atoi(argv[1]);
-    if (argc >= 3) iterations = atoi(argv[2]);
+    int message_size = 1;
+    int iterations = 10000;
+    int do_sweep = 0, modes = MODE_PINGPONG | MODE_STREAM | MODE_BIDIR | MODE_ALLPAIRS;
+    long min_bytes = 1, max_bytes = 64L << 20;
+    int sweep_iters = 1000, window = 64;
+    const char *csv_path = NULL;
+    int pos = 0, bad_mode = 0;
 
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    bench_t bench;
+    bench_init(&bench, "ping_pong", &argc, argv);
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--sweep") == 0) do_sweep = 1;
+        else if (strncmp(argv[i], "--mode=", 7) == 0) {
+            modes = parse_modes(argv[i] + 7);
+            if (modes <= 0) bad_mode = 1;
+        }
+        else if (strncmp(argv[i], "--min=", 6) == 0)    min_bytes = atol(argv[i] + 6);
+        else if (strncmp(argv[i], "--max=", 6) == 0)    max_bytes = atol(argv[i] + 6);
+        else if (strncmp(argv[i], "--iters=", 8) == 0)  sweep_iters = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--window=", 9) == 0) window = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--csv=", 6) == 0)    csv_path = argv[i] + 6;
+        else if (pos == 0) { message_size = atoi(argv[i]); ++pos; }
+        else if (pos == 1) { iterations = atoi(argv[i]); ++pos; }
+    }
+
+    if (do_sweep) {
+        const char *err = NULL;
+        if (bad_mode) err = "неизвестный режим в --mode";
+        else if (size < 2) err = "требуется не меньше 2 процессов";
+        else if (min_bytes < 0 || max_bytes < min_bytes || max_bytes > (1L << 30))
+            err = "некорректный диапазон размеров";
+        else if (sweep_iters < 10 || window < 1) err = "--iters должно быть >= 10, --window >= 1";
+        if (err) {
+            if (rank == 0) fprintf(stderr, "Ошибка: %s.\n", err);
+            MPI_Finalize();
+            return EXIT_FAILURE;
+        }
+        sweep(rank, size, modes, min_bytes, max_bytes, sweep_iters, window, csv_path);
+        MPI_Finalize();
+        return EXIT_SUCCESS;
+    }
 
     if (size != 2) {
         if (rank == 0) fprintf(stderr, "Ошибка: требуется ровно 2 процесса.\n");
         MPI_Finalize();
         return EXIT_FAILURE;
     }
+    if (message_size < 0 || iterations < 1) {
+        if (rank == 0) fprintf(stderr, "Ошибка: некорректные аргументы.\n");
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
 
-    char *buffer = (char*)malloc(message_size);
-    if (!buffer) {
+    char *buffer = (char*)malloc(message_size > 0 ? message_size : 1);
+    double *times = malloc(iterations * sizeof(double));
+    if (!buffer || !times) {
         fprintf(stderr, "Ошибка: не удалось выделить буфер размером %d байт.\n", message_size);
         MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
     }
@@ -41,27 +279,31 @@ int main(int argc, char *argv[]) {
 
     MPI_Barrier(MPI_COMM_WORLD);
 
-    for (int i = 0; i < iterations; ++i) {
-        if (rank == 0) {
-            t_start = MPI_Wtime();
-            MPI_Send(buffer, message_size, MPI_CHAR, 1, tag, MPI_COMM_WORLD);
-            MPI_Recv(buffer, message_size, MPI_CHAR, 1, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            t_end = MPI_Wtime();
-            total_time += (t_end - t_start);
-        } else {
-            MPI_Recv(buffer, message_size, MPI_CHAR, 0, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            MPI_Send(buffer, message_size, MPI_CHAR, 0, tag, MPI_COMM_WORLD);
-        }
-    }
+    int warmup = bench.warmup > 0 ? bench.warmup : iterations / 10 > 2 ? iterations / 10 : 2;
+    bench.warmup = warmup;
+    bench_config(&bench, "bytes", "%d", message_size);
+    bench_config(&bench, "iterations", "%d", iterations);
+    run_pingpong(buffer, message_size, warmup, iterations, times, rank);
 
     if (rank == 0) {
+        double total_time = 0.0;
+        for (int i = 0; i < iterations; ++i) total_time += 2.0 * times[i];
         double avg_time = total_time / iterations;
+        for (int i = 0; i < iterations; ++i) bench_add(&bench, 2.0 * times[i]);
+        double tmin, tmed, tp99;
+        stats(times, iterations, &tmin, &tmed, &tp99);
+        bench_metric(&bench, "p99", 2.0 * tp99);
         printf("Размер сообщения: %d байт\n", message_size);
-        printf("Итераций: %d\n", iterations);
+        printf("Итераций: %d (прогрев %d)\n", iterations, warmup);
         printf("Среднее время оборота (round-trip): %.6f мс\n", avg_time * 1e3);
+        printf("Оборот: минимум %.6f мс, медиана %.6f мс, 99%% %.6f мс\n",
+               2.0 * tmin * 1e3, 2.0 * tmed * 1e3, 2.0 * tp99 * 1e3);
     }
+    bench_write(&bench);
 
     free(buffer);
+    free(times);
+    free(bench.samples);
     MPI_Finalize();
     return 0;
 }
@@ -2,37 +2,61 @@ import pandas as pd
 import matplotlib.pyplot as plt
 import os
 
+def load_results():
+    """Сводит CSV из common/bench.h в таблицу P,M,K,mode,time (медиана).
+
+    P — общее число ядер (процессы × потоки); mode: seq, mpi (isend),
+    mpi-<способ обмена>, hybrid (больше одного потока на процесс).
+    """
+    seq = pd.read_csv('bench_seq.csv')
+    seq['P'] = 1
+    seq['mode'] = 'seq'
+    par = pd.read_csv('bench_mpi.csv')
+    par['P'] = par['ranks'] * par['threads']
+    par['mode'] = par['exchange'].map(lambda x: 'mpi' if x == 'isend' else 'mpi-' + x)
+    par.loc[par['threads'] > 1, 'mode'] = 'hybrid'
+    df = pd.concat([seq, par], ignore_index=True)
+    df['time'] = df['median']
+    return df[['P', 'M', 'K', 'mode', 'time', 'ci_lo', 'ci_hi']]
+
 def main():
     if not os.path.exists('plots'):
         os.makedirs('plots')
 
-    df = pd.read_csv('results.csv')
+    df = load_results()
     seq_df = df[(df['mode']=='seq') & (df['P']==1)]
 
-    mpi_df = df[df['mode']=='mpi']
-    for (M, K), group in mpi_df.groupby(['M','K']):
-        grp = group.sort_values('P').copy()
+    par_df = df[df['mode']!='seq']
+    for (M, K), group in par_df.groupby(['M','K']):
         T1 = float(seq_df[(seq_df['M']==M) & (seq_df['K']==K)]['time'].values[0])
-        grp['speedup']    = T1 / grp['time']
-        grp['efficiency'] = grp['speedup'] / grp['P']
-
-        plt.figure()
-        plt.plot(grp.P, grp.speedup, '-o', label=f'M={M},K={K}')
-        plt.xlabel('Число процессов P')
-        plt.ylabel('Ускорение S(P)')
-        plt.title(f'Strong scaling: M={M}, K={K}')
-        plt.grid(True)
-        plt.savefig(f'plots/speedup_M{M}_K{K}.png')
-        plt.close()
-
-        plt.figure()
-        plt.plot(grp.P, grp.efficiency, '-o', label=f'M={M},K={K}')
-        plt.xlabel('Число процессов P')
-        plt.ylabel('Эффективность E(P)')
-        plt.title(f'Efficiency: M={M}, K={K}')
-        plt.grid(True)
-        plt.savefig(f'plots/efficiency_M{M}_K{K}.png')
-        plt.close()
+
+        fig_s, ax_s = plt.subplots()
+        fig_e, ax_e = plt.subplots()
+        # mpi — процесс на ядро, hybrid — процесс на узел с потоками
+        for mode, mgrp in group.groupby('mode'):
+            grp = mgrp.sort_values('P').copy()
+            grp['speedup']    = T1 / grp['time']
+            grp['efficiency'] = grp['speedup'] / grp['P']
+            # Полосы — 95% доверительный интервал медианы времени
+            err = [grp.speedup - T1 / grp.ci_hi, T1 / grp.ci_lo - grp.speedup]
+            ax_s.errorbar(grp.P, grp.speedup, yerr=err, fmt='-o', capsize=3, label=mode)
+            ax_e.plot(grp.P, grp.efficiency, '-o', label=mode)
+
+        ax_s.set_xlabel('Число ядер P')
+        ax_s.set_ylabel('Ускорение S(P)')
+        ax_s.set_title(f'Strong scaling: M={M}, K={K}')
+        ax_s.grid(True)
+        ax_s.legend()
+        fig_s.savefig(f'plots/speedup_M{M}_K{K}.png')
+        plt.close(fig_s)
+
+        ax_e.set_xlabel('Число ядер P')
+        ax_e.set_ylabel('Эффективность E(P)')
+        ax_e.set_title(f'Efficiency: M={M}, K={K}')
+        ax_e.grid(True)
+        ax_e.legend()
+        fig_e.savefig(f'plots/efficiency_M{M}_K{K}.png')
+        plt.close(fig_e)
 
     print("Plots saved in current directory.")
 
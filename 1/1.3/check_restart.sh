@@ -0,0 +1,40 @@
+#!/bin/bash
+set -e
+
+# Проверка продолжения счёта с контрольной точки для всех способов обмена
+# гало: норма после --restart должна совпадать с нормой счёта без перерыва
+# побитово. Интервалы EVERYs дают последние контрольные точки на шагах k0
+# с k0 mod 3 = 1, 0, 2 (1801, 1401, 1601 при K=2000) — это проверяет выбор
+# набора постоянных запросов после перезапуска.
+MPIRUN=${MPIRUN:-mpirun}
+P=${P:-3}
+M=1000
+K=2000
+Xs=(isend persistent neighbor)
+Hs=(1 2)
+EVERYs=(600 700 800)
+CK=$(mktemp -u ckpt_XXXXXX.bin)
+trap 'rm -f "$CK"' EXIT
+
+norm() {
+  $MPIRUN -np $P ./transport_mpi $M $K "$@" | sed -n 's/.*Норма решения: //p'
+}
+
+status=0
+for X in "${Xs[@]}"; do
+  for H in "${Hs[@]}"; do
+    ref=$(norm --exchange=$X --halo=$H)
+    for E in "${EVERYs[@]}"; do
+      rm -f "$CK"
+      norm --exchange=$X --halo=$H --checkpoint="$CK" --checkpoint-every=$E > /dev/null
+      got=$(norm --exchange=$X --halo=$H --restart="$CK")
+      if [ "$got" = "$ref" ]; then
+        echo "OK   exchange=$X halo=$H every=$E: $got"
+      else
+        echo "FAIL exchange=$X halo=$H every=$E: $got, без перерыва $ref"
+        status=1
+      fi
+    done
+  done
+done
+exit $status
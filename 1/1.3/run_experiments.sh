@@ -1,33 +1,88 @@
 #!/bin/bash
 set -e
 
-# Скрипт для измерения времени работы transport_seq и transport_mpi
-# Генерирует results.csv с полями: P,M,K,mode,time
+# Скрипт для измерения времени работы transport_seq и transport_mpi.
+# Каждая точка — REPS повторов после WARMUP прогревочных; программы сами
+# пишут конфигурацию, медиану, IQR и доверительный интервал (common/bench.h):
+#   bench_seq.csv — transport_seq, bench_mpi.csv — transport_mpi,
+#   bench_ens.csv — режим ансамбля (--ensemble=B) обеих программ
+REPS=${REPS:-5}
+WARMUP=${WARMUP:-1}
+BENCH="--reps=$REPS --warmup=$WARMUP"
 
 # Число процессов для MPI
 Ps=(2 4 8)
+# Способы обмена гало (--exchange)
+Xs=(isend persistent neighbor)
+# Гибридный режим: NODES процессов (по одному на узел), в каждом Cs/NODES потоков
+NODES=${NODES:-1}
+Cs=(2 4 8 16 32)
 # Значения M (число отрезков по x)
 Ms=(1000 2000 5000 10000)
 
-# Заголовок для CSV
-echo "P,M,K,mode,time" > results.csv
+# Размеры ансамбля: много маленьких задач за один запуск
+Bs=(1 4 8 16 32 64)
+ENS_M=1000
 
-# Последовательная реализация (mode=seq, P=1)
+rm -f bench_seq.csv bench_mpi.csv bench_ens.csv
+
+# Последовательная реализация
 for M in "${Ms[@]}"; do
   for K in $M $((2*M)); do
     echo "Running sequential: M=$M, K=$K"
-    t=$(./transport_seq $M $K | awk '/Время решения:/ {print $3}')
-    echo "1,$M,$K,seq,$t" >> results.csv
+    ./transport_seq $M $K $BENCH --bench-out=bench_seq.csv
   done
  done
 
-# MPI реализация (mode=mpi, P>1)
+# MPI реализация, все способы обмена гало. При SWEEP=1 все точки идут
+# одним запуском mpirun (--sweep): группы процессов считают разные точки
+# одновременно, поэтому времена пригодны, только если ядер хватает на всех.
+if [ "${SWEEP:-0}" = 1 ]; then
+  SWEEP_FILE=sweep_mpi.txt
+  : > $SWEEP_FILE
+  for M in "${Ms[@]}"; do
+    for K in $M $((2*M)); do
+      for P in "${Ps[@]}"; do
+        for X in "${Xs[@]}"; do
+          echo "$P $M $K --exchange=$X" >> $SWEEP_FILE
+        done
+      done
+    done
+  done
+  PMAX=$(printf '%s\n' "${Ps[@]}" | sort -n | tail -1)
+  echo "Running MPI sweep: $(wc -l < $SWEEP_FILE) configurations on $PMAX processes"
+  mpirun -np $PMAX ./transport_mpi --sweep=$SWEEP_FILE $BENCH --bench-out=bench_mpi.csv
+else
+  for M in "${Ms[@]}"; do
+    for K in $M $((2*M)); do
+      for P in "${Ps[@]}"; do
+        for X in "${Xs[@]}"; do
+          echo "Running MPI: P=$P, M=$M, K=$K, exchange=$X"
+          mpirun -np $P ./transport_mpi $M $K --exchange=$X $BENCH --bench-out=bench_mpi.csv
+        done
+      done
+    done
+  done
+fi
+
+# Гибридная реализация MPI+потоки (NODES процессов по T потоков)
 for M in "${Ms[@]}"; do
   for K in $M $((2*M)); do
-    for P in "${Ps[@]}"; do
-      echo "Running MPI: P=$P, M=$M, K=$K"
-      t=$(mpirun -np $P ./transport_mpi $M $K | awk '/Время решения:/ {print $3}')
-      echo "$P,$M,$K,mpi,$t" >> results.csv
+    for C in "${Cs[@]}"; do
+      T=$((C / NODES))
+      [ "$T" -ge 1 ] || continue
+      echo "Running hybrid: nodes=$NODES, threads=$T, M=$M, K=$K"
+      mpirun -np $NODES --map-by ppr:1:node --bind-to none \
+            ./transport_mpi $M $K --threads=$T $BENCH --bench-out=bench_mpi.csv
     done
   done
- done 
\ No newline at end of file
+done
+
+# Ансамбль: пропускная способность (updates_per_s) в зависимости от B
+for B in "${Bs[@]}"; do
+  echo "Running ensemble: B=$B, M=$ENS_M"
+  ./transport_seq $ENS_M $ENS_M --ensemble=$B $BENCH --bench-out=bench_ens.csv
+  for P in "${Ps[@]}"; do
+    mpirun -np $P ./transport_mpi $ENS_M $ENS_M --ensemble=$B $BENCH --bench-out=bench_ens.csv
+  done
+done
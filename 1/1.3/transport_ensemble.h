@@ -0,0 +1,99 @@
+/*
+ * Ансамбль задач переноса для transport_seq и transport_mpi (--ensemble=B).
+ *
+ * Экземпляр e решает на общей сетке M×K
+ *
+ *   ∂u/∂t + a_e ∂u/∂x = s_e sin(πx),  u(0,x) = sin(k_e πx),  u(t,0) = u(t,X) = 0
+ *
+ * Параметры (a_e, k_e, s_e) читаются из файла --ensemble-params=FILE по
+ * строке «a k s» на экземпляр (пустые строки и строки с # пропускаются),
+ * иначе берётся семейство
+ *
+ *   a_e = a·(1 - e/(2B)),  k_e = 1 + e mod 4,  s_e = e mod 2.
+ *
+ * Экземпляр 0 по умолчанию совпадает с обычной задачей программы, и его
+ * норма равна норме одиночного запуска. Источник не зависит от времени и
+ * вычисляется один раз.
+ *
+ * Слои хранятся с чередованием: u[i·B + e] (ядра leapfrog_ens_* в
+ * transport_kernel.h), поэтому в MPI гало всех экземпляров — одна точка
+ * из B подряд идущих чисел и уходит одним сообщением на соседа за шаг.
+ */
+
+#ifndef TRANSPORT_ENSEMBLE_H
+#define TRANSPORT_ENSEMBLE_H
+
+#include <stdio.h>
+#include <math.h>
+
+typedef struct {
+    double a, k, s;
+} ens_param_t;
+
+/*
+ * Заполняет p[0..B). Возвращает 0, -1 если файл не открывается,
+ * -2 если в нём меньше B строк с параметрами.
+ */
+static int ens_params(ens_param_t *p, int B, const char *path, double a) {
+    if (!path) {
+        for (int e = 0; e < B; ++e) {
+            p[e].a = a * (1.0 - 0.5 * e / B);
+            p[e].k = 1 + e % 4;
+            p[e].s = e % 2;
+        }
+        return 0;
+    }
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char line[256];
+    int n = 0;
+    while (n < B && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%lf %lf %lf", &p[n].a, &p[n].k, &p[n].s) == 3) ++n;
+    }
+    fclose(f);
+    return n == B ? 0 : -2;
+}
+
+/*
+ * Начальные слои для точек с глобальными номерами gm0+i, lo <= i < hi:
+ * u_old (также в соседних точках i = lo-1 и i = hi, если они внутри
+ * [0, M]), u_cur по явному уголку и строка источника. lam[e] = a_e τ/h.
+ */
+static void ens_init(const ens_param_t *p, int B, int M, double h, double tau,
+                     int gm0, int lo, int hi, double *lam,
+                     double *u_old, double *u_cur, double *src) {
+    for (int e = 0; e < B; ++e) lam[e] = p[e].a * tau / h;
+    for (int i = lo - 1; i <= hi; ++i) {
+        int gm = gm0 + i;
+        if (gm < 0 || gm > M) continue;
+        double x = gm * h;
+        for (int e = 0; e < B; ++e) {
+            long q = (long)i * B + e;
+            int edge = (gm == 0 || gm == M);
+            u_old[q] = edge ? 0.0 : sin(p[e].k * M_PI * x);
+            src[q]   = edge ? 0.0 : p[e].s * sin(M_PI * x);
+        }
+    }
+    for (int i = lo; i < hi; ++i) {
+        int gm = gm0 + i;
+        for (int e = 0; e < B; ++e) {
+            long q = (long)i * B + e;
+            if (gm == 0 || gm == M) {
+                u_cur[q] = 0.0;
+            } else {
+                u_cur[q] = u_old[q]
+                           - lam[e] * (u_old[q] - u_old[q - B])
+                           + tau * src[q];
+            }
+        }
+    }
+}
+
+/* sq[e] += Σ u[i,e]², lo <= i < hi. */
+static void ens_sumsq(const double *u, int B, int lo, int hi, double *sq) {
+    for (int i = lo; i < hi; ++i)
+        for (int e = 0; e < B; ++e) sq[e] += u[(long)i * B + e] * u[(long)i * B + e];
+}
+
+#endif /* TRANSPORT_ENSEMBLE_H */
@@ -3,16 +3,111 @@
  * методом «схема крест» с использованием MPI.
  *
  * Компиляция:
- *   mpicc -O2 -o transport_mpi transport_mpi.c -lm
+ *   mpicc -O2 -pthread -o transport_mpi transport_mpi.c -lm
+ *   (с -DPERF_REGIONS — аппаратные счётчики по фазам, только Linux)
  *
  * Запуск:
- *   mpirun -np <P> ./transport_mpi [M] [K]
+ *   mpirun -np <P> ./transport_mpi [M] [K] [--halo=H]
+ *                                  [--kernel=auto|scalar|avx2|avx512]
+ *                                  [--threads=T|auto]
+ *                                  [--exchange=isend|persistent|neighbor]
+ *                                  [--dim=1|2|3]
+ *                                  [--checkpoint=FILE] [--checkpoint-every=N]
+ *                                  [--restart=FILE] [--output=FILE]
+ *                                  [--ensemble=B] [--ensemble-params=FILE]
+ *                                  [--reps=R] [--warmup=W] [--bench-out=FILE]
+ *   mpirun -np <P> ./transport_mpi --sweep=FILE [общие параметры]
+ *
+ * Гибридный режим (один процесс на узел или NUMA-домен):
+ *   mpirun -np <узлы> --map-by ppr:1:node --bind-to none \
+ *          ./transport_mpi M K --threads=auto
+ *
+ * Параметры:
+ *   --halo=H  ширина гало (по умолчанию 1). При H>1 соседи обмениваются
+ *             H ячейками u_cur и H-1 ячейками u_old один раз на H шагов,
+ *             после чего каждый процесс продвигает решение на H шагов
+ *             локально по сужающейся области (temporal blocking).
+ *             Число сообщений уменьшается в H раз, результат совпадает
+ *             с пошаговым обменом побитово.
+ *   --kernel  реализация ядра схемы (см. transport_kernel.h).
+ *   --threads число потоков на процесс (по умолчанию 1). Локальный слой
+ *             u_old/u_cur/u_new делится между постоянным пулом потоков,
+ *             каждый поток сам инициализирует свою часть (first touch),
+ *             шаги разделяются барьером с обращением смысла. MPI вызывает
+ *             только поток 0 (MPI_THREAD_FUNNELED). auto — число ядер узла,
+ *             делённое на число процессов на узле.
+ *   --exchange способ обмена гало:
+ *             isend      — MPI_Isend/MPI_Irecv на каждом шаге (по умолчанию);
+ *             persistent — MPI_Send_init/MPI_Recv_init один раз, затем
+ *                          MPI_Startall; три набора запросов следуют
+ *                          за циклической перестановкой u_old/u_cur/u_new;
+ *             neighbor   — MPI_Ineighbor_alltoall на одномерном
+ *                          декартовом коммуникаторе.
+ *   --dim     размерность задачи (по умолчанию 1). При D=2,3 решается
+ *             u_t + a Σ_d ∂u/∂x_d = f в кубе [0,X]^D на сетке M^D,
+ *             процессы образуют решётку MPI_Cart_create, грани гало
+ *             описываются MPI_Type_create_subarray, внутренность блока
+ *             считается одновременно с обменом граней. D=1 — прежний
+ *             одномерный решатель со всеми режимами выше.
+ *   --checkpoint=FILE, --checkpoint-every=N
+ *             каждые N шагов сохранять u_old, u_cur и номер шага в общий
+ *             двоичный файл коллективной записью MPI-IO (при H>1 — на
+ *             границе ближайшего блока).
+ *   --restart=FILE  продолжить счёт с контрольной точки; число процессов
+ *             может отличаться от того, с которым она была записана.
+ *   --output=FILE   записать итоговое поле в том же формате.
+ *   --ensemble=B, --ensemble-params=FILE
+ *             решать B независимых одномерных задач с разными a, φ и
+ *             источником (transport_ensemble.h). Поля хранятся с
+ *             чередованием экземпляров, гало всех B задач уходит одним
+ *             сообщением на соседа за шаг; внутренние точки считаются во
+ *             время обмена. Несовместимо с --dim>1, --halo>1, --threads>1,
+ *             --exchange и контрольными точками.
+ *   --reps, --warmup, --bench-out  повторить решение (с начальных условий
+ *             или с контрольной точки) W+R раз, печатать медиану времени
+ *             по R замерам и записать статистику (common/bench.h).
+ *   --sweep=FILE  перебор конфигураций за один запуск MPI. Каждая строка
+ *             файла — «P [M] [K] [параметры]», параметры дополняют общие
+ *             из командной строки (--reps, --warmup и --bench-out задаются
+ *             только там). MPI_COMM_WORLD делится MPI_Comm_split на группы
+ *             по P процессов, и группы считают свои конфигурации
+ *             одновременно, раундами (см. run_sweep). Замеры пишутся в
+ *             формате отдельных запусков, ranks — размер группы. У строк
+ *             с --dim>1 и --ensemble свои столбцы, поэтому при FILE.csv
+ *             они идут в FILE.nd.csv и FILE.ens.csv.
+ *
+ * Сборка с -DPERF_REGIONS: каждый поток считает такты, инструкции,
+ * промахи LLC и ветвлений отдельно для обмена гало (halo: запуск и
+ * завершение обмена с граничными точками), внутреннего обновления
+ * (interior), оболочки блока в D>1 и крайних точек ансамбля (shell),
+ * ожидания на барьере (barrier) и записи контрольных точек. В конце
+ * процесс 0 печатает суммы по процессам, IPC и оценку пропускной
+ * способности по промахам LLC (common/perfctr.h). Без флага макросы пустые.
+ *
+ * Формат файла контрольной точки: заголовок ckpt_header_t, дополненный
+ * нулями до CKPT_DATA_OFFSET байт, затем u_old[0..M] и u_cur[0..M]
+ * (double в порядке байтов машины). u_cur — слой с номером step.
  */
 
 #include <mpi.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "transport_kernel.h"
+#include "transport_ensemble.h"
+#include "../../common/bench.h"
+#include "../../common/perfctr.h"
+
+/* Области счётчиков, сборка с -DPERF_REGIONS (см. common/perfctr.h). */
+enum { R_HALO, R_INTERIOR, R_SHELL, R_BARRIER, R_CKPT, NREGIONS };
+static const char *region_names[NREGIONS] = {"halo", "interior", "shell", "barrier", "checkpoint"};
 
 static const double a = 1.0;
 static const double X = 1.0;
@@ -27,145 +122,1408 @@ double psi(double t) {
 double f_src(double t, double x) {
     return 0.0;
 }
+static const int f_src_zero = 1;
 
-int main(int argc, char *argv[]) {
-    MPI_Init(&argc, &argv);
-    int rank, size;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+/* Многомерные аналоги φ и f: x — массив из D координат. */
+double phi_nd(const double *x, int D) {
+    double v = 1.0;
+    for (int d = 0; d < D; ++d) v *= sin(M_PI * x[d]);
+    return v;
+}
+double f_src_nd(double t, const double *x, int D) {
+    return 0.0;
+}
 
-    int M = 1000, K = 1000;
-    if (argc >= 2) M = atoi(argv[1]);
-    if (argc >= 3) K = atoi(argv[2]);
+/* Барьер с обращением смысла: после ~1000 пустых итераций уступает ядро. */
+typedef struct {
+    atomic_int count;
+    atomic_int sense;
+    int        n;
+} spin_barrier_t;
 
-    double h = X / M;
-    double tau = T / K;
-    double lambda = a * tau / h;
-    if (rank == 0 && fabs(lambda) > 1.0) {
-        fprintf(stderr, "Внимание: условие Куранта λ=%.3f>1, схема может быть неустойчива.\n", lambda);
+static void spin_barrier_init(spin_barrier_t *b, int n) {
+    atomic_init(&b->count, n);
+    atomic_init(&b->sense, 0);
+    b->n = n;
+}
+
+static void spin_barrier_wait(spin_barrier_t *b, int *local_sense) {
+    int sense = !*local_sense;
+    *local_sense = sense;
+    if (atomic_fetch_sub_explicit(&b->count, 1, memory_order_acq_rel) == 1) {
+        atomic_store_explicit(&b->count, b->n, memory_order_relaxed);
+        atomic_store_explicit(&b->sense, sense, memory_order_release);
+    } else {
+        int spins = 0;
+        while (atomic_load_explicit(&b->sense, memory_order_acquire) != sense) {
+            if (++spins == 1024) {
+                sched_yield();
+                spins = 0;
+            }
+        }
     }
+}
 
-    int numPoints = M + 1;
-    int base  = numPoints / size;
-    int rem   = numPoints % size;
-    int local_n = (rank < rem) ? base + 1 : base;
-    int start   = (rank < rem)
-                  ? rank * (base + 1)
-                  : rem * (base + 1) + (rank - rem) * base;
+enum { EXCH_ISEND, EXCH_PERSISTENT, EXCH_NEIGHBOR };
+static const char *exchange_names[] = {"isend", "persistent", "neighbor"};
 
-    double *u_old = malloc((local_n + 2) * sizeof(double));
-    double *u_cur = malloc((local_n + 2) * sizeof(double));
-    double *u_new = malloc((local_n + 2) * sizeof(double));
-    if (!u_old || !u_cur || !u_new) {
-        fprintf(stderr, "Ошибка выделения памяти на rank %d.\n", rank);
+/* Состояние решателя на одном процессе, общее для всех его потоков. */
+typedef struct {
+    int M, K, H, nthreads;
+    double h, tau, lambda;
+    leapfrog_fn kern;
+
+    /* Коммуникатор решателя: MPI_COMM_WORLD или группа --sweep. */
+    MPI_Comm comm;
+    int rank, size, left, right;
+    int start, local_n;
+
+    /* Локальные индексы 1-H .. local_n+H; при H=1 это 0 .. local_n+1. */
+    double *u_old, *u_cur, *u_new, *src, *xs, *halo_buf;
+
+    /* Обмен гало: preq[j] — запросы для u_cur = j-го исходного массива,
+       deep_req — для буфера глубокого гало, nbuf — для neighbor-режима. */
+    int exchange;
+    MPI_Comm cart;
+    MPI_Request preq[3][4];
+    MPI_Request deep_req[4];
+    MPI_Request req[4];
+    double nbuf[4];
+
+    /* Контрольные точки: k0 — номер слоя u_cur в начале счёта. */
+    const char *ckpt_path, *restart_path, *output_path;
+    int ckpt_every, k0, nckpt;
+    double io_time;
+
+    spin_barrier_t bar;
+    double elapsed;
+} solver_t;
+
+#define CKPT_MAGIC       "TRCKPT1"
+#define CKPT_DATA_OFFSET 64
+
+typedef struct {
+    char    magic[8];
+    int32_t M, K;
+    int32_t step;
+    int32_t reserved;
+    double  h, tau;
+} ckpt_header_t;
+
+_Static_assert(sizeof(ckpt_header_t) <= CKPT_DATA_OFFSET, "заголовок не помещается");
+
+static void ckpt_fail(const char *what, const char *path, int rc) {
+    char msg[MPI_MAX_ERROR_STRING];
+    int len;
+    MPI_Error_string(rc, msg, &len);
+    fprintf(stderr, "Ошибка: %s %s: %s\n", what, path, msg);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+/*
+ * Коллективная запись u_old и u_cur (слой step). Каждый процесс пишет свои
+ * точки [start, start+local_n) по их глобальным смещениям, заголовок —
+ * процесс 0.
+ */
+static void checkpoint_write(solver_t *s, const char *path,
+                             const double *u_old, const double *u_cur, int step) {
+    MPI_File fh;
+    int rc = MPI_File_open(s->comm, path, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+                           MPI_INFO_NULL, &fh);
+    if (rc != MPI_SUCCESS) ckpt_fail("не удалось открыть", path, rc);
+    MPI_Offset plane = (MPI_Offset)(s->M + 1) * sizeof(double);
+    MPI_File_set_size(fh, CKPT_DATA_OFFSET + 2 * plane);
+
+    ckpt_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+    hdr.M = s->M;
+    hdr.K = s->K;
+    hdr.step = step;
+    hdr.h = s->h;
+    hdr.tau = s->tau;
+    char block[CKPT_DATA_OFFSET] = {0};
+    memcpy(block, &hdr, sizeof(hdr));
+    MPI_File_write_at_all(fh, 0, block, s->rank == 0 ? CKPT_DATA_OFFSET : 0,
+                          MPI_BYTE, MPI_STATUS_IGNORE);
+
+    MPI_Offset off = CKPT_DATA_OFFSET + (MPI_Offset)s->start * sizeof(double);
+    rc = MPI_File_write_at_all(fh, off, &u_old[1], s->local_n, MPI_DOUBLE,
+                               MPI_STATUS_IGNORE);
+    if (rc == MPI_SUCCESS)
+        rc = MPI_File_write_at_all(fh, off + plane, &u_cur[1], s->local_n, MPI_DOUBLE,
+                                   MPI_STATUS_IGNORE);
+    if (rc != MPI_SUCCESS) ckpt_fail("не удалось записать", path, rc);
+    MPI_File_close(&fh);
+}
+
+/* Периодическая контрольная точка из цикла по времени (поток 0). */
+static void checkpoint_step(solver_t *s, const double *u_old, const double *u_cur, int step) {
+    double t0 = MPI_Wtime();
+    checkpoint_write(s, s->ckpt_path, u_old, u_cur, step);
+    s->io_time += MPI_Wtime() - t0;
+    s->nckpt++;
+}
+
+/* Чтение контрольной точки; возвращает номер слоя u_cur. */
+static int checkpoint_read(solver_t *s, const char *path, double *u_old, double *u_cur) {
+    MPI_File fh;
+    int rc = MPI_File_open(s->comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    if (rc != MPI_SUCCESS) ckpt_fail("не удалось открыть", path, rc);
+
+    ckpt_header_t hdr;
+    rc = MPI_File_read_at_all(fh, 0, &hdr, sizeof(hdr), MPI_BYTE, MPI_STATUS_IGNORE);
+    if (rc != MPI_SUCCESS) ckpt_fail("не удалось прочитать", path, rc);
+    if (memcmp(hdr.magic, CKPT_MAGIC, sizeof(CKPT_MAGIC)) != 0
+        || hdr.M != s->M || hdr.K != s->K) {
+        if (s->rank == 0)
+            fprintf(stderr, "Ошибка: %s не является контрольной точкой для M=%d, K=%d.\n",
+                    path, s->M, s->K);
         MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
-    for (int i = 1; i <= local_n; ++i) {
-        int gm = start + i - 1;
-        double x = gm * h;
-        u_old[i] = phi(x);
+    MPI_Offset plane = (MPI_Offset)(s->M + 1) * sizeof(double);
+    MPI_Offset off = CKPT_DATA_OFFSET + (MPI_Offset)s->start * sizeof(double);
+    rc = MPI_File_read_at_all(fh, off, &u_old[1], s->local_n, MPI_DOUBLE,
+                              MPI_STATUS_IGNORE);
+    if (rc == MPI_SUCCESS)
+        rc = MPI_File_read_at_all(fh, off + plane, &u_cur[1], s->local_n, MPI_DOUBLE,
+                                  MPI_STATUS_IGNORE);
+    if (rc != MPI_SUCCESS) ckpt_fail("не удалось прочитать", path, rc);
+    MPI_File_close(&fh);
+    return hdr.step;
+}
+
+typedef struct {
+    solver_t *s;
+    int tid;
+} worker_arg_t;
+
+/* Часть [lo, hi) полуинтервала, принадлежащая потоку tid. */
+static void thread_range(int lo, int hi, int nthreads, int tid, int *tlo, int *thi) {
+    long n = hi > lo ? hi - lo : 0;
+    *tlo = lo + (int)(n * tid / nthreads);
+    *thi = lo + (int)(n * (tid + 1) / nthreads);
+}
+
+/*
+ * Создание постоянных запросов и декартова коммуникатора. Для шагового
+ * обмена заводится по набору на каждый из трёх массивов: после j
+ * перестановок роль u_cur играет массив с номером (j + 1) mod 3. Счёт
+ * начинается с шага k0 (после --restart — со слоя контрольной точки) с
+ * исходной расстановкой, поэтому на шаге k это набор (k - k0 + 1) mod 3.
+ */
+static void halo_setup(solver_t *s) {
+    int n = s->local_n, H = s->H;
+    int cnt = 2 * H - 1;
+    double *sbuf = s->halo_buf, *rbuf = s->halo_buf + 2 * cnt;
+    double *arr[3] = {s->u_old, s->u_cur, s->u_new};
+
+    s->cart = MPI_COMM_NULL;
+    if (s->exchange == EXCH_NEIGHBOR) {
+        int dims[1] = {s->size}, periods[1] = {0};
+        MPI_Cart_create(s->comm, 1, dims, periods, 0, &s->cart);
     }
-    if (start == 0) {
-        u_old[1] = phi(0.0);
-        u_old[0] = phi(0.0);
+    if (s->exchange != EXCH_PERSISTENT) return;
+
+    for (int j = 0; j < 3 && H == 1; ++j) {
+        double *u = arr[j];
+        MPI_Recv_init(&u[0],     1, MPI_DOUBLE, s->left,  0, s->comm, &s->preq[j][0]);
+        MPI_Recv_init(&u[n + 1], 1, MPI_DOUBLE, s->right, 1, s->comm, &s->preq[j][1]);
+        MPI_Send_init(&u[1],     1, MPI_DOUBLE, s->left,  1, s->comm, &s->preq[j][2]);
+        MPI_Send_init(&u[n],     1, MPI_DOUBLE, s->right, 0, s->comm, &s->preq[j][3]);
     }
-    if (start + local_n - 1 == M) {
-        u_old[local_n]   = 0.0;
-        u_old[local_n+1] = 0.0;
+    if (H > 1) {
+        MPI_Recv_init(rbuf,       cnt, MPI_DOUBLE, s->left,  0, s->comm, &s->deep_req[0]);
+        MPI_Recv_init(rbuf + cnt, cnt, MPI_DOUBLE, s->right, 1, s->comm, &s->deep_req[1]);
+        MPI_Send_init(sbuf,       cnt, MPI_DOUBLE, s->left,  1, s->comm, &s->deep_req[2]);
+        MPI_Send_init(sbuf + cnt, cnt, MPI_DOUBLE, s->right, 0, s->comm, &s->deep_req[3]);
     }
+}
 
-    int left  = rank - 1, right = rank + 1;
-    if (left  < 0)     left  = MPI_PROC_NULL;
-    if (right >= size) right = MPI_PROC_NULL;
-    MPI_Sendrecv(&u_old[local_n], 1, MPI_DOUBLE, right, 0,
-                 &u_old[0],      1, MPI_DOUBLE, left,  0,
-                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Sendrecv(&u_old[1],       1, MPI_DOUBLE, left,  1,
-                 &u_old[local_n+1],1, MPI_DOUBLE, right, 1,
-                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+static void halo_free(solver_t *s) {
+    if (s->exchange == EXCH_PERSISTENT) {
+        for (int j = 0; j < 3 && s->H == 1; ++j)
+            for (int r = 0; r < 4; ++r) MPI_Request_free(&s->preq[j][r]);
+        for (int r = 0; r < 4 && s->H > 1; ++r) MPI_Request_free(&s->deep_req[r]);
+    }
+    if (s->cart != MPI_COMM_NULL) MPI_Comm_free(&s->cart);
+}
 
-    double t1 = tau;
-    if (start == 0) {
-        u_cur[1] = psi(t1);
+/* Начало шагового обмена крайними точками u_cur (шаг k). */
+static void halo_start(solver_t *s, double *u_cur, int k) {
+    int n = s->local_n;
+    switch (s->exchange) {
+    case EXCH_PERSISTENT:
+        MPI_Startall(4, s->preq[(k - s->k0 + 1) % 3]);
+        break;
+    case EXCH_NEIGHBOR:
+        /* Порядок соседей в декартовой топологии: левый, правый. */
+        s->nbuf[0] = u_cur[1];
+        s->nbuf[1] = u_cur[n];
+        MPI_Ineighbor_alltoall(s->nbuf, 1, MPI_DOUBLE, s->nbuf + 2, 1, MPI_DOUBLE,
+                               s->cart, &s->req[0]);
+        break;
+    default:
+        MPI_Irecv(&u_cur[0],     1, MPI_DOUBLE, s->left,  0, s->comm, &s->req[0]);
+        MPI_Irecv(&u_cur[n + 1], 1, MPI_DOUBLE, s->right, 1, s->comm, &s->req[1]);
+        MPI_Isend(&u_cur[1],     1, MPI_DOUBLE, s->left,  1, s->comm, &s->req[2]);
+        MPI_Isend(&u_cur[n],     1, MPI_DOUBLE, s->right, 0, s->comm, &s->req[3]);
+    }
+}
+
+static void halo_finish(solver_t *s, double *u_cur, int k) {
+    switch (s->exchange) {
+    case EXCH_PERSISTENT:
+        MPI_Waitall(4, s->preq[(k - s->k0 + 1) % 3], MPI_STATUSES_IGNORE);
+        break;
+    case EXCH_NEIGHBOR:
+        MPI_Wait(&s->req[0], MPI_STATUS_IGNORE);
+        if (s->left  != MPI_PROC_NULL) u_cur[0]              = s->nbuf[2];
+        if (s->right != MPI_PROC_NULL) u_cur[s->local_n + 1] = s->nbuf[3];
+        break;
+    default:
+        MPI_Waitall(4, s->req, MPI_STATUSES_IGNORE);
+    }
+}
+
+/*
+ * Обмен глубоким гало: левому соседу уходят u_cur[1..H] и u_old[1..H-1],
+ * правому — u_cur[n-H+1..n] и u_old[n-H+2..n]; принимается симметрично
+ * в u_cur[1-H..0], u_old[2-H..0] и u_cur[n+1..n+H], u_old[n+1..n+H-1].
+ * Оба массива упаковываются в одно сообщение на направление.
+ */
+static void exchange_deep_halo(solver_t *s, double *u_old, double *u_cur) {
+    int H = s->H, local_n = s->local_n;
+    int cnt = 2 * H - 1;
+    double *sl = s->halo_buf, *sr = sl + cnt;
+    double *rl = s->halo_buf + 2 * cnt, *rr = rl + cnt;
+
+    memcpy(sl,     &u_cur[1], H * sizeof(double));
+    memcpy(sl + H, &u_old[1], (H - 1) * sizeof(double));
+    memcpy(sr,     &u_cur[local_n - H + 1], H * sizeof(double));
+    memcpy(sr + H, &u_old[local_n - H + 2], (H - 1) * sizeof(double));
+
+    switch (s->exchange) {
+    case EXCH_PERSISTENT:
+        MPI_Startall(4, s->deep_req);
+        MPI_Waitall(4, s->deep_req, MPI_STATUSES_IGNORE);
+        break;
+    case EXCH_NEIGHBOR:
+        MPI_Neighbor_alltoall(sl, cnt, MPI_DOUBLE, rl, cnt, MPI_DOUBLE, s->cart);
+        break;
+    default: {
+        MPI_Request reqs[4];
+        MPI_Irecv(rl, cnt, MPI_DOUBLE, s->left,  0, s->comm, &reqs[0]);
+        MPI_Irecv(rr, cnt, MPI_DOUBLE, s->right, 1, s->comm, &reqs[1]);
+        MPI_Isend(sl, cnt, MPI_DOUBLE, s->left,  1, s->comm, &reqs[2]);
+        MPI_Isend(sr, cnt, MPI_DOUBLE, s->right, 0, s->comm, &reqs[3]);
+        MPI_Waitall(4, reqs, MPI_STATUSES_IGNORE);
+    }
     }
-    for (int i = 1; i <= local_n; ++i) {
+
+    if (s->left != MPI_PROC_NULL) {
+        memcpy(&u_cur[1 - H], rl,     H * sizeof(double));
+        memcpy(&u_old[2 - H], rl + H, (H - 1) * sizeof(double));
+    }
+    if (s->right != MPI_PROC_NULL) {
+        memcpy(&u_cur[local_n + 1], rr,     H * sizeof(double));
+        memcpy(&u_old[local_n + 1], rr + H, (H - 1) * sizeof(double));
+    }
+}
+
+/*
+ * Начальные слои и цикл по времени для потока tid. Поток 0 дополнительно
+ * выполняет все обмены MPI и расставляет граничные значения.
+ */
+static void *worker(void *arg) {
+    worker_arg_t *wa = arg;
+    solver_t *s = wa->s;
+    int tid = wa->tid, nthreads = s->nthreads;
+    int M = s->M, K = s->K, H = s->H;
+    int start = s->start, local_n = s->local_n;
+    int left = s->left, right = s->right;
+    double h = s->h, tau = s->tau, lambda = s->lambda;
+    leapfrog_fn kern = s->kern;
+    double *u_old = s->u_old, *u_cur = s->u_cur, *u_new = s->u_new;
+    double *src = s->src, *xs = s->xs;
+    int sense = 0;
+    PERF_THREAD(tid);
+
+    /* Первое касание: каждый поток заполняет свою часть слоя. */
+    int olo, ohi;
+    thread_range(1, local_n + 1, nthreads, tid, &olo, &ohi);
+    if (tid == 0) olo = 1 - H;
+    if (tid == nthreads - 1) ohi = local_n + H + 1;
+    for (int i = olo; i < ohi; ++i) {
+        xs[i] = (start + i - 1) * h;
+        u_old[i] = (i >= 1 && i <= local_n) ? phi(xs[i]) : 0.0;
+        u_cur[i] = 0.0;
+        u_new[i] = 0.0;
+        src[i]   = 0.0;
+    }
+    spin_barrier_wait(&s->bar, &sense);
+
+    if (s->restart_path) {
+        if (tid == 0) s->k0 = checkpoint_read(s, s->restart_path, u_old, u_cur);
+        spin_barrier_wait(&s->bar, &sense);
+        goto timed;
+    }
+
+    if (tid == 0) {
+        if (start == 0) {
+            u_old[1] = phi(0.0);
+            u_old[0] = phi(0.0);
+        }
+        if (start + local_n - 1 == M) {
+            u_old[local_n]   = 0.0;
+            u_old[local_n+1] = 0.0;
+        }
+        MPI_Sendrecv(&u_old[local_n], 1, MPI_DOUBLE, right, 0,
+                     &u_old[0],      1, MPI_DOUBLE, left,  0,
+                     s->comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv(&u_old[1],       1, MPI_DOUBLE, left,  1,
+                     &u_old[local_n+1],1, MPI_DOUBLE, right, 1,
+                     s->comm, MPI_STATUS_IGNORE);
+    }
+    spin_barrier_wait(&s->bar, &sense);
+
+    double t1 = tau;
+    thread_range(1, local_n + 1, nthreads, tid, &olo, &ohi);
+    for (int i = olo; i < ohi; ++i) {
         int gm = start + i - 1;
-        if (gm == 0) continue;
-        if (gm == M) {
+        if (gm == 0) {
+            u_cur[i] = psi(t1);
+        } else if (gm == M) {
             u_cur[i] = 0.0;
         } else {
-            double x = gm * h;
             u_cur[i] = u_old[i]
                        - lambda * (u_old[i] - u_old[i-1])
-                       + tau * f_src(0.0, x);
+                       + tau * f_src(0.0, xs[i]);
         }
     }
-    if (start == 0)      u_cur[0]        = psi(t1);
-    if (start + local_n - 1 == M) u_cur[local_n+1] = 0.0;
+    if (tid == 0) {
+        if (start == 0)      u_cur[0]        = psi(t1);
+        if (start + local_n - 1 == M) u_cur[local_n+1] = 0.0;
+    }
+    spin_barrier_wait(&s->bar, &sense);
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    double t_start = MPI_Wtime();
+timed:;
+    int k0 = s->k0;
+    int next_ckpt = s->ckpt_every > 0 ? k0 + s->ckpt_every : K;
+    double t_start = 0.0;
+    if (tid == 0) {
+        MPI_Barrier(s->comm);
+        t_start = MPI_Wtime();
+    }
+    spin_barrier_wait(&s->bar, &sense);
+
+    for (int k = k0; k < K && H > 1; ) {
+        int steps = (K - k < H) ? K - k : H;
+        if (tid == 0) {
+            PERF_BEGIN(R_HALO);
+            exchange_deep_halo(s, u_old, u_cur);
+            PERF_END(R_HALO);
+        }
+        PERF_BEGIN(R_BARRIER);
+        spin_barrier_wait(&s->bar, &sense);
+        PERF_END(R_BARRIER);
 
-    for (int k = 1; k < K; ++k) {
+        /* Шаг j вычисляет точки на steps-1-j за пределами своей области. */
+        for (int j = 0; j < steps; ++j, ++k) {
+            double t_k  = k * tau;
+            double t_k1 = (k + 1) * tau;
+            int ext = steps - 1 - j;
+            int lo = 1 - ext, hi = local_n + ext;
+            /* Граничные узлы gm=0 и gm=M задаются отдельно, ядро — внутри. */
+            if (start + lo - 1 <= 0) {
+                lo = 2 - start;
+                if (tid == 0) u_new[1 - start] = psi(t_k1);
+            }
+            if (start + hi - 1 >= M) {
+                hi = M - start;
+                if (tid == 0) u_new[M - start + 1] = 0.0;
+            }
+            int tlo, thi;
+            thread_range(lo, hi + 1, nthreads, tid, &tlo, &thi);
+            PERF_BEGIN(R_INTERIOR);
+            if (!f_src_zero) {
+                for (int i = tlo; i < thi; ++i) src[i] = f_src(t_k, xs[i]);
+            }
+            kern(u_new, u_old, u_cur, f_src_zero ? NULL : src,
+                 lambda, 2.0 * tau, tlo, thi);
+            PERF_END(R_INTERIOR);
+            PERF_BEGIN(R_BARRIER);
+            spin_barrier_wait(&s->bar, &sense);
+            PERF_END(R_BARRIER);
+            double *tmp = u_old; u_old = u_cur; u_cur = u_new; u_new = tmp;
+        }
+        /* k — номер слоя в u_cur; запись идёт, пока остальные потоки
+           начинают следующий блок, не трогающий u_old и u_cur. */
+        if (k >= next_ckpt && k < K) {
+            if (tid == 0) {
+                PERF_BEGIN(R_CKPT);
+                checkpoint_step(s, u_old, u_cur, k);
+                PERF_END(R_CKPT);
+            }
+            while (next_ckpt <= k) next_ckpt += s->ckpt_every;
+        }
+    }
+
+    int ilo, ihi;
+    thread_range(2, local_n, nthreads, tid, &ilo, &ihi);
+    for (int k = k0; k < K && H == 1; ++k) {
         double t_k  = k * tau;
         double t_k1 = (k + 1) * tau;
-        MPI_Request reqs[4];
-        MPI_Irecv(&u_cur[0],          1, MPI_DOUBLE, left,  0,
-                  MPI_COMM_WORLD, &reqs[0]);
-        MPI_Irecv(&u_cur[local_n+1],  1, MPI_DOUBLE, right, 1,
-                  MPI_COMM_WORLD, &reqs[1]);
-        MPI_Isend(&u_cur[1],          1, MPI_DOUBLE, left,  1,
-                  MPI_COMM_WORLD, &reqs[2]);
-        MPI_Isend(&u_cur[local_n],    1, MPI_DOUBLE, right, 0,
-                  MPI_COMM_WORLD, &reqs[3]);
-
-        for (int i = 2; i <= local_n-1; ++i) {
-            int gm = start + i - 1;
-            double x = gm * h;
-            u_new[i] = u_old[i]
-                       - lambda * (u_cur[i+1] - u_cur[i-1])
-                       + 2.0 * tau * f_src(t_k, x);
+        if (tid == 0) {
+            PERF_BEGIN(R_HALO);
+            halo_start(s, u_cur, k);
+            PERF_END(R_HALO);
         }
 
-        MPI_Waitall(4, reqs, MPI_STATUSES_IGNORE);
+        PERF_BEGIN(R_INTERIOR);
+        if (!f_src_zero) {
+            for (int i = ilo; i < ihi; ++i) src[i] = f_src(t_k, xs[i]);
+        }
+        kern(u_new, u_old, u_cur, f_src_zero ? NULL : src,
+             lambda, 2.0 * tau, ilo, ihi);
+        PERF_END(R_INTERIOR);
 
-        if (start == 0) {
-            u_new[1] = psi(t_k1);
-        } else {
-            int gm = start;
-            double x = gm * h;
-            u_new[1] = u_old[1]
-                       - lambda * (u_cur[2] - u_cur[0])
-                       + 2.0 * tau * f_src(t_k, x);
+        if (tid == 0) {
+            PERF_BEGIN(R_HALO);
+            halo_finish(s, u_cur, k);
+
+            if (start == 0) {
+                u_new[1] = psi(t_k1);
+            } else {
+                int gm = start;
+                double x = gm * h;
+                u_new[1] = u_old[1]
+                           - lambda * (u_cur[2] - u_cur[0])
+                           + 2.0 * tau * f_src(t_k, x);
+            }
+            if (start + local_n - 1 == M) {
+                u_new[local_n] = 0.0;
+            } else {
+                int gm = start + local_n - 1;
+                double x = gm * h;
+                u_new[local_n] = u_old[local_n]
+                                 - lambda * (u_cur[local_n+1] - u_cur[local_n-1])
+                                 + 2.0 * tau * f_src(t_k, x);
+            }
+            PERF_END(R_HALO);
         }
-        if (start + local_n - 1 == M) {
-            u_new[local_n] = 0.0;
-        } else {
-            int gm = start + local_n - 1;
-            double x = gm * h;
-            u_new[local_n] = u_old[local_n]
-                             - lambda * (u_cur[local_n+1] - u_cur[local_n-1])
-                             + 2.0 * tau * f_src(t_k, x);
+        if (nthreads > 1) {
+            PERF_BEGIN(R_BARRIER);
+            spin_barrier_wait(&s->bar, &sense);
+            PERF_END(R_BARRIER);
         }
 
         double *tmp = u_old; u_old = u_cur; u_cur = u_new; u_new = tmp;
+        if (k + 1 == next_ckpt && k + 1 < K) {
+            if (tid == 0) {
+                PERF_BEGIN(R_CKPT);
+                checkpoint_step(s, u_old, u_cur, k + 1);
+                PERF_END(R_CKPT);
+            }
+            next_ckpt += s->ckpt_every;
+        }
+    }
+
+    if (tid == 0) {
+        MPI_Barrier(s->comm);
+        s->elapsed = MPI_Wtime() - t_start;
+        s->u_old = u_old;
+        s->u_cur = u_cur;
+        s->u_new = u_new;
+    }
+    return NULL;
+}
+
+/*
+ * Многомерный решатель. Массивы хранятся как трёхмерные; при D<3 первые
+ * 3-D осей неактивны (одна точка, без гало), так что последняя ось всегда
+ * непрерывна в памяти. Ось ax процесса соответствует измерению
+ * ax-(3-D) декартовой решётки.
+ */
+typedef struct {
+    int D, M, K;
+    double h, tau, lambda;
+    MPI_Comm cart;
+    int n[3], g[3], start[3], ext[3];
+    long st[3];                  /* шаг по оси в массиве, 0 для неактивных */
+    long len;
+    int nb_lo[3], nb_hi[3];
+    MPI_Datatype send_lo[3], send_hi[3], recv_lo[3], recv_hi[3];
+} grid_nd_t;
+
+static inline long nd_idx(const grid_nd_t *G, int i0, int i1, int i2) {
+    return ((long)(i0 + G->g[0]) * G->ext[1] + (i1 + G->g[1])) * G->ext[2]
+           + (i2 + G->g[2]);
+}
+
+static void nd_coords(const grid_nd_t *G, int i0, int i1, int i2, double *x) {
+    int idx[3] = {i0, i1, i2};
+    for (int ax = 3 - G->D, d = 0; ax < 3; ++ax, ++d)
+        x[d] = (G->start[ax] + idx[ax]) * G->h;
+}
+
+/* Схема «крест» в прямоугольнике [lo, hi) локальных индексов. */
+static void nd_update_box(const grid_nd_t *G, double *u_new, const double *u_old,
+                          const double *u_cur, double t_k,
+                          const int lo[3], const int hi[3]) {
+    long s0 = G->st[0], s1 = G->st[1], s2 = G->st[2];
+    double lambda = G->lambda, tau2 = 2.0 * G->tau;
+    int len = hi[2] - lo[2];
+    if (len <= 0) return;
+    for (int i0 = lo[0]; i0 < hi[0]; ++i0) {
+        for (int i1 = lo[1]; i1 < hi[1]; ++i1) {
+            long p = nd_idx(G, i0, i1, lo[2]);
+            double *restrict un = u_new + p;
+            const double *restrict uo = u_old + p;
+            const double *restrict uc = u_cur + p;
+            if (G->D == 3) {
+                for (int i = 0; i < len; ++i)
+                    un[i] = uo[i] - lambda * ((uc[i+s0] - uc[i-s0])
+                                              + (uc[i+s1] - uc[i-s1])
+                                              + (uc[i+s2] - uc[i-s2]));
+            } else {
+                for (int i = 0; i < len; ++i)
+                    un[i] = uo[i] - lambda * ((uc[i+s1] - uc[i-s1])
+                                              + (uc[i+s2] - uc[i-s2]));
+            }
+            if (!f_src_zero) {
+                double x[3];
+                for (int i = 0; i < len; ++i) {
+                    nd_coords(G, i0, i1, lo[2] + i, x);
+                    un[i] += tau2 * f_src_nd(t_k, x, G->D);
+                }
+            }
+        }
+    }
+}
+
+static void nd_fill_box(const grid_nd_t *G, double *u, double v,
+                        const int lo[3], const int hi[3]) {
+    for (int i0 = lo[0]; i0 < hi[0]; ++i0)
+        for (int i1 = lo[1]; i1 < hi[1]; ++i1)
+            for (int i2 = lo[2]; i2 < hi[2]; ++i2)
+                u[nd_idx(G, i0, i1, i2)] = v;
+}
+
+/* Граничные условия: ψ(t) на гранях x_d=0, ноль на гранях x_d=X. */
+static void nd_apply_bc(const grid_nd_t *G, double *u, double t) {
+    for (int high = 0; high <= 1; ++high) {
+        for (int ax = 3 - G->D; ax < 3; ++ax) {
+            int lo[3] = {0, 0, 0}, hi[3] = {G->n[0], G->n[1], G->n[2]};
+            if (!high && G->start[ax] == 0) {
+                hi[ax] = 1;
+                nd_fill_box(G, u, psi(t), lo, hi);
+            }
+            if (high && G->start[ax] + G->n[ax] - 1 == G->M) {
+                lo[ax] = G->n[ax] - 1;
+                nd_fill_box(G, u, 0.0, lo, hi);
+            }
+        }
+    }
+}
+
+static void nd_exchange_start(const grid_nd_t *G, double *u, MPI_Request *reqs, int *nreq) {
+    int r = 0;
+    for (int ax = 3 - G->D; ax < 3; ++ax) {
+        int tag = 2 * ax;
+        MPI_Irecv(u, 1, G->recv_lo[ax], G->nb_lo[ax], tag,     G->cart, &reqs[r++]);
+        MPI_Irecv(u, 1, G->recv_hi[ax], G->nb_hi[ax], tag + 1, G->cart, &reqs[r++]);
+        MPI_Isend(u, 1, G->send_lo[ax], G->nb_lo[ax], tag + 1, G->cart, &reqs[r++]);
+        MPI_Isend(u, 1, G->send_hi[ax], G->nb_hi[ax], tag,     G->cart, &reqs[r++]);
+    }
+    *nreq = r;
+}
+
+/*
+ * Точки блока, соседние с гало, — объединение непересекающихся слоёв:
+ * для оси ax берутся i_ax = 0 и i_ax = n-1, по предыдущим осям только
+ * внутренние индексы, по последующим — все.
+ */
+static void nd_update_shell(const grid_nd_t *G, double *u_new, const double *u_old,
+                            const double *u_cur, double t_k) {
+    for (int ax = 3 - G->D; ax < 3; ++ax) {
+        int lo[3], hi[3];
+        for (int e = 0; e < 3; ++e) {
+            int inner = (e < ax && G->g[e]);
+            lo[e] = inner ? 1 : 0;
+            hi[e] = inner ? G->n[e] - 1 : G->n[e];
+        }
+        lo[ax] = 0;
+        hi[ax] = 1;
+        nd_update_box(G, u_new, u_old, u_cur, t_k, lo, hi);
+        if (G->n[ax] > 1) {
+            lo[ax] = G->n[ax] - 1;
+            hi[ax] = G->n[ax];
+            nd_update_box(G, u_new, u_old, u_cur, t_k, lo, hi);
+        }
+    }
+}
+
+static int run_nd(bench_t *bench, MPI_Comm comm, int D, int M, int K) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    grid_nd_t G;
+    G.D = D; G.M = M; G.K = K;
+    G.h = X / M;
+    G.tau = T / K;
+    G.lambda = a * G.tau / G.h;
+    if (rank == 0 && fabs(D * G.lambda) > 1.0) {
+        fprintf(stderr, "Внимание: условие Куранта D·λ=%.3f>1, схема может быть неустойчива.\n",
+                D * G.lambda);
+    }
+
+    int cdims[3] = {0, 0, 0}, periods[3] = {0, 0, 0}, ccoords[3];
+    MPI_Dims_create(size, D, cdims);
+    if (M + 1 < cdims[0] || M + 1 < cdims[D - 1]) {
+        if (rank == 0) fprintf(stderr, "Ошибка: слишком много процессов для M=%d.\n", M);
+        return EXIT_FAILURE;
+    }
+    MPI_Cart_create(comm, D, cdims, periods, 1, &G.cart);
+    int crank;
+    MPI_Comm_rank(G.cart, &crank);
+    MPI_Cart_coords(G.cart, crank, D, ccoords);
+
+    int numPoints = M + 1;
+    for (int ax = 0; ax < 3; ++ax) {
+        int d = ax - (3 - D);
+        if (d < 0) {
+            G.n[ax] = 1; G.g[ax] = 0; G.start[ax] = 0;
+            G.nb_lo[ax] = G.nb_hi[ax] = MPI_PROC_NULL;
+            continue;
+        }
+        int base = numPoints / cdims[d], rem = numPoints % cdims[d], c = ccoords[d];
+        G.n[ax] = (c < rem) ? base + 1 : base;
+        G.start[ax] = (c < rem) ? c * (base + 1) : rem * (base + 1) + (c - rem) * base;
+        G.g[ax] = 1;
+        MPI_Cart_shift(G.cart, d, 1, &G.nb_lo[ax], &G.nb_hi[ax]);
+    }
+    for (int ax = 0; ax < 3; ++ax) G.ext[ax] = G.n[ax] + 2 * G.g[ax];
+    G.st[2] = G.g[2] ? 1 : 0;
+    G.st[1] = G.g[1] ? G.ext[2] : 0;
+    G.st[0] = G.g[0] ? (long)G.ext[1] * G.ext[2] : 0;
+    G.len = (long)G.ext[0] * G.ext[1] * G.ext[2];
+
+    /* Грани: слой толщины 1 по оси ax на всю внутренность по остальным осям. */
+    for (int ax = 3 - D; ax < 3; ++ax) {
+        int sub[3], st[3];
+        for (int e = 0; e < 3; ++e) {
+            sub[e] = G.n[e];
+            st[e] = G.g[e];
+        }
+        sub[ax] = 1;
+        int pos[4] = {1, G.n[ax], 0, G.n[ax] + 1};
+        MPI_Datatype *types[4] = {&G.send_lo[ax], &G.send_hi[ax], &G.recv_lo[ax], &G.recv_hi[ax]};
+        for (int f = 0; f < 4; ++f) {
+            st[ax] = pos[f];
+            MPI_Type_create_subarray(3, G.ext, sub, st, MPI_ORDER_C, MPI_DOUBLE, types[f]);
+            MPI_Type_commit(types[f]);
+        }
+    }
+
+    double *u_old = calloc(G.len, sizeof(double));
+    double *u_cur = calloc(G.len, sizeof(double));
+    double *u_new = calloc(G.len, sizeof(double));
+    if (!u_old || !u_cur || !u_new) {
+        fprintf(stderr, "Ошибка выделения памяти на rank %d.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    int in_lo[3], in_hi[3];
+    for (int ax = 0; ax < 3; ++ax) {
+        in_lo[ax] = G.g[ax] ? 1 : 0;
+        in_hi[ax] = G.g[ax] ? G.n[ax] - 1 : G.n[ax];
+        if (in_hi[ax] < in_lo[ax]) in_hi[ax] = in_lo[ax];
+    }
+
+    double *layer[3] = {u_old, u_cur, u_new};
+    for (int r = 0; r < bench_runs(bench); ++r) {
+        u_old = layer[0];
+        u_cur = layer[1];
+        u_new = layer[2];
+        double x[3];
+        for (int i0 = 0; i0 < G.n[0]; ++i0)
+            for (int i1 = 0; i1 < G.n[1]; ++i1)
+                for (int i2 = 0; i2 < G.n[2]; ++i2) {
+                    nd_coords(&G, i0, i1, i2, x);
+                    u_old[nd_idx(&G, i0, i1, i2)] = phi_nd(x, D);
+                }
+        nd_apply_bc(&G, u_old, 0.0);
+
+        MPI_Request reqs[12];
+        int nreq;
+        nd_exchange_start(&G, u_old, reqs, &nreq);
+        MPI_Waitall(nreq, reqs, MPI_STATUSES_IGNORE);
+
+        /* Первый шаг — явный уголок по каждому направлению. */
+        double t1 = G.tau;
+        for (int i0 = 0; i0 < G.n[0]; ++i0)
+            for (int i1 = 0; i1 < G.n[1]; ++i1)
+                for (int i2 = 0; i2 < G.n[2]; ++i2) {
+                    long p = nd_idx(&G, i0, i1, i2);
+                    double d = 0.0;
+                    for (int ax = 3 - D; ax < 3; ++ax) d += u_old[p] - u_old[p - G.st[ax]];
+                    nd_coords(&G, i0, i1, i2, x);
+                    u_cur[p] = u_old[p] - G.lambda * d + G.tau * f_src_nd(0.0, x, D);
+                }
+        nd_apply_bc(&G, u_cur, t1);
+
+        MPI_Barrier(comm);
+        double t_start = MPI_Wtime();
+
+        for (int k = 1; k < K; ++k) {
+            double t_k  = k * G.tau;
+            double t_k1 = (k + 1) * G.tau;
+            PERF_BEGIN(R_HALO);
+            nd_exchange_start(&G, u_cur, reqs, &nreq);
+            PERF_END(R_HALO);
+            PERF_BEGIN(R_INTERIOR);
+            nd_update_box(&G, u_new, u_old, u_cur, t_k, in_lo, in_hi);
+            PERF_END(R_INTERIOR);
+            PERF_BEGIN(R_HALO);
+            MPI_Waitall(nreq, reqs, MPI_STATUSES_IGNORE);
+            PERF_END(R_HALO);
+            PERF_BEGIN(R_SHELL);
+            nd_update_shell(&G, u_new, u_old, u_cur, t_k);
+            nd_apply_bc(&G, u_new, t_k1);
+            PERF_END(R_SHELL);
+            double *tmp = u_old; u_old = u_cur; u_cur = u_new; u_new = tmp;
+        }
+
+        MPI_Barrier(comm);
+        bench_record(bench, r, MPI_Wtime() - t_start);
     }
+    double elapsed = bench_median(bench);
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    double t_end = MPI_Wtime();
-    double elapsed = t_end - t_start;
+    double local_sq = 0.0, global_sq = 0.0;
+    for (int i0 = 0; i0 < G.n[0]; ++i0)
+        for (int i1 = 0; i1 < G.n[1]; ++i1)
+            for (int i2 = 0; i2 < G.n[2]; ++i2) {
+                double v = u_cur[nd_idx(&G, i0, i1, i2)];
+                local_sq += v * v;
+            }
+    MPI_Reduce(&local_sq, &global_sq, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
 
     if (rank == 0) {
-        printf("MPI-параллельная реализация:\n");  
-        printf("  Процессы: %d, M=%d, K=%d, λ=%.3f\n", 
-               size, M, K, lambda);
+        printf("MPI-параллельная реализация (%dD):\n", D);
+        printf("  Процессы: %d (решётка %d", size, cdims[0]);
+        for (int d = 1; d < D; ++d) printf("x%d", cdims[d]);
+        printf("), M=%d, K=%d, λ=%.3f\n", M, K, G.lambda);
         printf("  Время решения: %.6f с\n", elapsed);
+        printf("  Норма решения: %.15e\n", sqrt(pow(G.h, D) * global_sq));
+        bench_metric(bench, "norm", sqrt(pow(G.h, D) * global_sq));
+    }
+    bench_finish(bench);
+    PERF_REPORT(region_names, NREGIONS);
+
+    for (int ax = 3 - D; ax < 3; ++ax) {
+        MPI_Type_free(&G.send_lo[ax]);
+        MPI_Type_free(&G.send_hi[ax]);
+        MPI_Type_free(&G.recv_lo[ax]);
+        MPI_Type_free(&G.recv_hi[ax]);
+    }
+    MPI_Comm_free(&G.cart);
+    free(layer[0]);
+    free(layer[1]);
+    free(layer[2]);
+    return EXIT_SUCCESS;
+}
+
+/* --ensemble: B одномерных задач сразу, обмен isend. */
+static int run_ensemble(bench_t *bench, MPI_Comm comm, int M, int K, int B,
+                        const char *params_path, const char *kernel_name) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    const char *kernel_used;
+    leapfrog_ens_fn kern = leapfrog_ens_select(kernel_name, &kernel_used);
+    if (!kern) {
+        if (rank == 0) fprintf(stderr, "Ошибка: ядро %s недоступно.\n", kernel_name);
+        return EXIT_FAILURE;
+    }
+    int numPoints = M + 1;
+    int base  = numPoints / size;
+    int rem   = numPoints % size;
+    int local_n = (rank < rem) ? base + 1 : base;
+    int start   = (rank < rem)
+                  ? rank * (base + 1)
+                  : rem * (base + 1) + (rank - rem) * base;
+    if (base < 2) {
+        if (rank == 0) fprintf(stderr, "Ошибка: меньше двух точек на процесс.\n");
+        return EXIT_FAILURE;
+    }
+    int left  = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+    int right = rank < size - 1 ? rank + 1 : MPI_PROC_NULL;
+
+    /* Параметры читает процесс 0 и рассылает остальным. */
+    ens_param_t *par = malloc(B * sizeof(ens_param_t));
+    int rc = 0;
+    if (rank == 0) rc = ens_params(par, B, params_path, a);
+    MPI_Bcast(&rc, 1, MPI_INT, 0, comm);
+    if (rc != 0) {
+        if (rank == 0)
+            fprintf(stderr, rc == -1 ? "Ошибка: не удалось открыть %s.\n"
+                                     : "Ошибка: в %s меньше B строк «a k s».\n", params_path);
+        free(par);
+        return EXIT_FAILURE;
+    }
+    MPI_Bcast(par, 3 * B, MPI_DOUBLE, 0, comm);
+
+    double h = X / M;
+    double tau = T / K;
+    int with_src = 0;
+    double lam_max = 0.0;
+    for (int e = 0; e < B; ++e) {
+        if (par[e].s != 0.0) with_src = 1;
+        if (fabs(par[e].a * tau / h) > lam_max) lam_max = fabs(par[e].a * tau / h);
+    }
+    if (rank == 0 && lam_max > 1.0) {
+        fprintf(stderr, "Внимание: условие Куранта max λ=%.3f>1, схема может быть неустойчива.\n", lam_max);
+    }
+
+    size_t n = (size_t)(local_n + 2) * B;
+    double *layer[3] = {calloc(n, sizeof(double)), calloc(n, sizeof(double)), calloc(n, sizeof(double))};
+    double *src = calloc(n, sizeof(double));
+    double *lam = malloc(B * sizeof(double));
+    double *sq  = calloc(B, sizeof(double));
+    double *gsq = calloc(B, sizeof(double));
+    if (!layer[0] || !layer[1] || !layer[2] || !src || !lam || !sq || !gsq) {
+        fprintf(stderr, "Ошибка выделения памяти на rank %d.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    bench_config(bench, "M", "%d", M);
+    bench_config(bench, "K", "%d", K);
+    bench_config(bench, "kernel", "%s", kernel_used);
+    bench_config(bench, "ensemble", "%d", B);
+    bench_config(bench, "params", "%s", params_path ? params_path : "default");
+
+    double *u_old = NULL, *u_cur = NULL, *u_new = NULL;
+    for (int r = 0; r < bench_runs(bench); ++r) {
+        u_old = layer[0];
+        u_cur = layer[1];
+        u_new = layer[2];
+        /* Локальная точка i — глобальная start+i-1; гало u_old считается на месте. */
+        ens_init(par, B, M, h, tau, start - 1, 1, local_n + 1, lam, u_old, u_cur, src);
+
+        MPI_Barrier(comm);
+        double t_start = MPI_Wtime();
+        for (int k = 1; k < K; ++k) {
+            MPI_Request req[4];
+            PERF_BEGIN(R_HALO);
+            MPI_Irecv(&u_cur[0],                   B, MPI_DOUBLE, left,  0, comm, &req[0]);
+            MPI_Irecv(&u_cur[(size_t)(local_n + 1) * B], B, MPI_DOUBLE, right, 1, comm, &req[1]);
+            MPI_Isend(&u_cur[(size_t)local_n * B], B, MPI_DOUBLE, right, 0, comm, &req[2]);
+            MPI_Isend(&u_cur[B],                   B, MPI_DOUBLE, left,  1, comm, &req[3]);
+            PERF_END(R_HALO);
+
+            PERF_BEGIN(R_INTERIOR);
+            kern(u_new, u_old, u_cur, with_src ? src : NULL, lam, 2.0 * tau, B, 2, local_n);
+            PERF_END(R_INTERIOR);
+
+            PERF_BEGIN(R_HALO);
+            MPI_Waitall(4, req, MPI_STATUSES_IGNORE);
+            PERF_END(R_HALO);
+
+            /* Крайние точки; на границах отрезка ψ = 0 и u(t,X) = 0. */
+            PERF_BEGIN(R_SHELL);
+            kern(u_new, u_old, u_cur, with_src ? src : NULL, lam, 2.0 * tau, B, 1, 2);
+            kern(u_new, u_old, u_cur, with_src ? src : NULL, lam, 2.0 * tau, B, local_n, local_n + 1);
+            if (start == 0) memset(&u_new[B], 0, B * sizeof(double));
+            if (start + local_n - 1 == M) memset(&u_new[(size_t)local_n * B], 0, B * sizeof(double));
+            PERF_END(R_SHELL);
+
+            double *tmp = u_old; u_old = u_cur; u_cur = u_new; u_new = tmp;
+        }
+        MPI_Barrier(comm);
+        bench_record(bench, r, MPI_Wtime() - t_start);
+    }
+    double elapsed = bench_median(bench);
+
+    ens_sumsq(u_cur, B, 1, local_n + 1, sq);
+    MPI_Reduce(sq, gsq, B, MPI_DOUBLE, MPI_SUM, 0, comm);
+    if (rank == 0) {
+        double mean = 0.0;
+        for (int e = 0; e < B; ++e) mean += sqrt(h * gsq[e]) / B;
+        double rate = (double)B * (M - 1) * (K - 1) / elapsed;
+        printf("MPI-параллельная реализация, ансамбль:\n");
+        printf("  Процессы: %d, B=%d, M=%d, K=%d, max λ=%.3f, ядро=%s, параметры=%s\n",
+               size, B, M, K, lam_max, kernel_used, params_path ? params_path : "по умолчанию");
+        printf("  Время решения: %.6f с\n", elapsed);
+        printf("  Обновлений точек в секунду: %.3e\n", rate);
+        printf("  Норма решения (экземпляр 0): %.15e\n", sqrt(h * gsq[0]));
+        printf("  Средняя норма по ансамблю: %.15e\n", mean);
+        bench_metric(bench, "norm", sqrt(h * gsq[0]));
+        bench_metric(bench, "norm_mean", mean);
+        bench_metric(bench, "updates_per_s", rate);
+    }
+    bench_finish(bench);
+    PERF_REPORT(region_names, NREGIONS);
+
+    free(layer[0]);
+    free(layer[1]);
+    free(layer[2]);
+    free(src);
+    free(par);
+    free(lam);
+    free(sq);
+    free(gsq);
+    return EXIT_SUCCESS;
+}
+
+/* Параметры одного запуска решателя: командная строка или строка --sweep. */
+typedef struct {
+    int M, K, H, nthreads, D;
+    const char *kernel_name;
+    const char *ckpt_path, *restart_path, *output_path;
+    int ckpt_every;
+    int ensemble;
+    const char *ens_path;
+    int exchange;
+} transport_opts_t;
+
+static void transport_defaults(transport_opts_t *o) {
+    memset(o, 0, sizeof(*o));
+    o->M = 1000; o->K = 1000; o->H = 1; o->nthreads = 1; o->D = 1;
+    o->kernel_name = "auto";
+    o->exchange = EXCH_ISEND;
+}
+
+/* Разбор args[0..n) поверх значений, уже записанных в o. */
+static void transport_parse(transport_opts_t *o, int n, char **args) {
+    int npos = 0;
+    for (int i = 0; i < n; ++i) {
+        if (strncmp(args[i], "--halo=", 7) == 0) {
+            o->H = atoi(args[i] + 7);
+        } else if (strncmp(args[i], "--kernel=", 9) == 0) {
+            o->kernel_name = args[i] + 9;
+        } else if (strncmp(args[i], "--exchange=", 11) == 0) {
+            o->exchange = -1;
+            for (int e = 0; e < 3; ++e)
+                if (strcmp(args[i] + 11, exchange_names[e]) == 0) o->exchange = e;
+        } else if (strncmp(args[i], "--checkpoint=", 13) == 0) {
+            o->ckpt_path = args[i] + 13;
+        } else if (strncmp(args[i], "--checkpoint-every=", 19) == 0) {
+            o->ckpt_every = atoi(args[i] + 19);
+        } else if (strncmp(args[i], "--restart=", 10) == 0) {
+            o->restart_path = args[i] + 10;
+        } else if (strncmp(args[i], "--output=", 9) == 0) {
+            o->output_path = args[i] + 9;
+        } else if (strncmp(args[i], "--ensemble=", 11) == 0) {
+            o->ensemble = atoi(args[i] + 11);
+        } else if (strncmp(args[i], "--ensemble-params=", 18) == 0) {
+            o->ens_path = args[i] + 18;
+        } else if (strncmp(args[i], "--dim=", 6) == 0) {
+            o->D = atoi(args[i] + 6);
+        } else if (strncmp(args[i], "--threads=", 10) == 0) {
+            o->nthreads = (strcmp(args[i] + 10, "auto") == 0) ? 0 : atoi(args[i] + 10);
+        } else if (npos == 0) {
+            o->M = atoi(args[i]); ++npos;
+        } else if (npos == 1) {
+            o->K = atoi(args[i]); ++npos;
+        }
+    }
+}
+
+/*
+ * Решение задачи o на процессах comm. Печатает процесс 0 коммуникатора,
+ * запись замеров — в bench. MPI не завершает: при ошибке параметров все
+ * процессы comm возвращают EXIT_FAILURE.
+ */
+static int transport_run(MPI_Comm comm, const transport_opts_t *o, bench_t *bench,
+                         int provided) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int M = o->M, K = o->K, H = o->H, nthreads = o->nthreads, D = o->D;
+    const char *kernel_name = o->kernel_name;
+    const char *ckpt_path = o->ckpt_path, *restart_path = o->restart_path;
+    const char *output_path = o->output_path;
+    int ckpt_every = o->ckpt_every;
+    int ensemble = o->ensemble;
+    const char *ens_path = o->ens_path;
+    int exchange = o->exchange;
+    if (H < 1) {
+        if (rank == 0) fprintf(stderr, "Ошибка: ширина гало должна быть >= 1.\n");
+        return EXIT_FAILURE;
+    }
+    if (exchange < 0) {
+        if (rank == 0) fprintf(stderr, "Ошибка: неизвестный способ обмена.\n");
+        return EXIT_FAILURE;
+    }
+    if (ckpt_every > 0 && !ckpt_path) {
+        if (rank == 0) fprintf(stderr, "Ошибка: --checkpoint-every требует --checkpoint=FILE.\n");
+        return EXIT_FAILURE;
     }
+    if (D < 1 || D > 3) {
+        if (rank == 0) fprintf(stderr, "Ошибка: размерность должна быть 1, 2 или 3.\n");
+        return EXIT_FAILURE;
+    }
+    if (ensemble > 0) {
+        if (D != 1 || H != 1 || nthreads != 1 || exchange != EXCH_ISEND
+            || ckpt_path || restart_path || output_path) {
+            if (rank == 0)
+                fprintf(stderr, "Ошибка: --ensemble несовместим с --dim, --halo, --threads, "
+                                "--exchange и контрольными точками.\n");
+            return EXIT_FAILURE;
+        }
+        bench->name = "transport_mpi_ens";
+        return run_ensemble(bench, comm, M, K, ensemble, ens_path, kernel_name);
+    }
+    if (D > 1) {
+        if (H != 1 || nthreads != 1 || exchange != EXCH_ISEND
+            || ckpt_path || restart_path || output_path) {
+            if (rank == 0)
+                fprintf(stderr, "Ошибка: --halo, --threads, --exchange и контрольные точки "
+                                "поддерживаются только при --dim=1.\n");
+            return EXIT_FAILURE;
+        }
+        bench_config(bench, "M", "%d", M);
+        bench_config(bench, "K", "%d", K);
+        bench_config(bench, "dim", "%d", D);
+        return run_nd(bench, comm, D, M, K);
+    }
+    const char *kernel_used;
+    leapfrog_fn kern = leapfrog_select(kernel_name, &kernel_used);
+    if (!kern) {
+        if (rank == 0) fprintf(stderr, "Ошибка: ядро %s недоступно.\n", kernel_name);
+        return EXIT_FAILURE;
+    }
+    if (nthreads == 0) {
+        MPI_Comm node;
+        int node_size;
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank,
+                            MPI_INFO_NULL, &node);
+        MPI_Comm_size(node, &node_size);
+        MPI_Comm_free(&node);
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN) / node_size;
+        if (nthreads < 1) nthreads = 1;
+    }
+    if (nthreads > 1 && provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) fprintf(stderr, "Ошибка: MPI не поддерживает MPI_THREAD_FUNNELED.\n");
+        return EXIT_FAILURE;
+    }
+
+    solver_t s;
+    s.M = M; s.K = K; s.H = H; s.nthreads = nthreads;
+    s.h = X / M;
+    s.tau = T / K;
+    s.lambda = a * s.tau / s.h;
+    s.kern = kern;
+    s.exchange = exchange;
+    s.ckpt_path = ckpt_path;
+    s.restart_path = restart_path;
+    s.output_path = output_path;
+    s.ckpt_every = ckpt_path ? ckpt_every : 0;
+    s.k0 = 1;
+    s.nckpt = 0;
+    s.io_time = 0.0;
+    s.comm = comm;
+    s.rank = rank; s.size = size;
+    if (rank == 0 && fabs(s.lambda) > 1.0) {
+        fprintf(stderr, "Внимание: условие Куранта λ=%.3f>1, схема может быть неустойчива.\n", s.lambda);
+    }
+
+    int numPoints = M + 1;
+    int base  = numPoints / size;
+    int rem   = numPoints % size;
+    s.local_n = (rank < rem) ? base + 1 : base;
+    s.start   = (rank < rem)
+                ? rank * (base + 1)
+                : rem * (base + 1) + (rank - rem) * base;
+    if (base < H) {
+        if (rank == 0)
+            fprintf(stderr, "Ошибка: ширина гало H=%d больше числа точек на процесс (%d).\n",
+                    H, base);
+        return EXIT_FAILURE;
+    }
+    s.left  = rank - 1;
+    s.right = rank + 1;
+    if (s.left  < 0)     s.left  = MPI_PROC_NULL;
+    if (s.right >= size) s.right = MPI_PROC_NULL;
+
+    int len = s.local_n + 2 * H;
+    double *u_old = malloc(len * sizeof(double));
+    double *u_cur = malloc(len * sizeof(double));
+    double *u_new = malloc(len * sizeof(double));
+    double *src   = malloc(len * sizeof(double));
+    double *xs    = malloc(len * sizeof(double));
+    s.halo_buf    = malloc(4 * (2 * H - 1) * sizeof(double));
+    if (!u_old || !u_cur || !u_new || !src || !xs || !s.halo_buf) {
+        fprintf(stderr, "Ошибка выделения памяти на rank %d.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    s.u_old = u_old + H - 1;
+    s.u_cur = u_cur + H - 1;
+    s.u_new = u_new + H - 1;
+    s.src   = src + H - 1;
+    s.xs    = xs + H - 1;
+    halo_setup(&s);
+
+    bench_config(bench, "M", "%d", M);
+    bench_config(bench, "K", "%d", K);
+    bench_config(bench, "dim", "%d", D);
+    bench_config(bench, "threads", "%d", nthreads);
+    bench_config(bench, "halo", "%d", H);
+    bench_config(bench, "kernel", "%s", kernel_used);
+    bench_config(bench, "exchange", "%s", exchange_names[exchange]);
+
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    worker_arg_t *args = malloc(nthreads * sizeof(worker_arg_t));
+    for (int t = 0; t < nthreads; ++t) {
+        args[t].s = &s;
+        args[t].tid = t;
+    }
+    /* Повтор начинается с исходной расстановки слоёв (к ней привязаны
+       постоянные запросы обмена, набор k mod 3) и нового барьера: потоки
+       каждого повтора начинают со смысла 0. */
+    for (int r = 0; r < bench_runs(bench); ++r) {
+        s.u_old = u_old + H - 1;
+        s.u_cur = u_cur + H - 1;
+        s.u_new = u_new + H - 1;
+        s.k0 = 1;
+        s.nckpt = 0;
+        s.io_time = 0.0;
+        spin_barrier_init(&s.bar, nthreads);
+        for (int t = 1; t < nthreads; ++t) {
+            pthread_create(&threads[t], NULL, worker, &args[t]);
+        }
+        worker(&args[0]);
+        for (int t = 1; t < nthreads; ++t) {
+            pthread_join(threads[t], NULL);
+        }
+        bench_record(bench, r, s.elapsed);
+    }
+    s.elapsed = bench_median(bench);
+
+    halo_free(&s);
+    if (output_path) checkpoint_write(&s, output_path, s.u_old, s.u_cur, K);
+
+    double local_sq = 0.0, global_sq = 0.0;
+    for (int i = 1; i <= s.local_n; ++i) local_sq += s.u_cur[i] * s.u_cur[i];
+    MPI_Reduce(&local_sq, &global_sq, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+    if (rank == 0) {
+        printf("MPI-параллельная реализация:\n");  
+        printf("  Процессы: %d, потоки: %d, M=%d, K=%d, λ=%.3f, гало H=%d, ядро=%s, обмен=%s\n", 
+               size, nthreads, M, K, s.lambda, H, kernel_used, exchange_names[exchange]);
+        printf("  Время решения: %.6f с\n", s.elapsed);
+        if (s.k0 > 1) printf("  Продолжено с шага %d\n", s.k0);
+        if (s.nckpt > 0)
+            printf("  Контрольные точки: %d, время записи %.6f с (%.1f%%)\n",
+                   s.nckpt, s.io_time, 100.0 * s.io_time / s.elapsed);
+        printf("  Норма решения: %.15e\n", sqrt(s.h * global_sq));
+        bench_metric(bench, "norm", sqrt(s.h * global_sq));
+    }
+    bench_finish(bench);
+    PERF_REPORT(region_names, NREGIONS);
 
     free(u_old);
     free(u_cur);
     free(u_new);
+    free(src);
+    free(xs);
+    free(s.halo_buf);
+    free(threads);
+    free(args);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * --sweep=FILE: перебор конфигураций за один запуск MPI. Строка файла —
+ * «P [M] [K] [параметры]» (пустые строки и текст после # пропускаются):
+ * число процессов и параметры в том же виде, что в командной строке; они
+ * дополняют общие параметры командной строки. Конфигурации упорядочены по
+ * убыванию P, затем объёма M^D·K·B, и раскладываются по раундам: в раунд
+ * по порядку попадают все, что помещаются в ещё свободные процессы. В
+ * раунде MPI_COMM_WORLD делится MPI_Comm_split на группы подряд идущих
+ * процессов, каждая решает свою задачу на своём коммуникаторе, а
+ * незанятые процессы ждут следующего раунда.
+ */
+#define SWEEP_MAX_CONF 256
+#define SWEEP_MAX_PATH 4096
+#define SWEEP_MAX_ARGS 32
+
+typedef struct {
+    int P, line, round, first;
+    double cost;
+    int nargs;
+    char *args[SWEEP_MAX_ARGS];
+} sweep_conf_t;
+
+/*
+ * Файл замеров строки o: в CSV заголовок пишется один раз, поэтому
+ * строки с другим набором столбцов (D>1, ансамбль) получают свой файл.
+ */
+static const char *sweep_bench_out(const char *out, const transport_opts_t *o,
+                                   char *buf, size_t cap) {
+    const char *tag = o->ensemble > 0 ? "ens" : o->D > 1 ? "nd" : NULL;
+    size_t len = out ? strlen(out) : 0;
+    if (!tag || len < 4 || strcmp(out + len - 4, ".csv") != 0) return out;
+    snprintf(buf, cap, "%.*s.%s.csv", (int)(len - 4), out, tag);
+    return buf;
+}
+
+static int sweep_cmp(const void *x, const void *y) {
+    const sweep_conf_t *p = x, *q = y;
+    if (p->P != q->P) return q->P - p->P;
+    if (p->cost != q->cost) return p->cost < q->cost ? 1 : -1;
+    return p->line - q->line;
+}
+
+static int run_sweep(const char *path, const transport_opts_t *base,
+                     const bench_t *tmpl, int provided) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    /* Файл читает процесс 0 и рассылает текст остальным. */
+    long len = -1;
+    char *text = NULL;
+    if (rank == 0) {
+        FILE *f = fopen(path, "r");
+        if (f) {
+            fseek(f, 0, SEEK_END);
+            len = ftell(f);
+            fseek(f, 0, SEEK_SET);
+            text = len >= 0 ? malloc(len + 1) : NULL;
+            if (!text || fread(text, 1, len, f) != (size_t)len) len = -1;
+            fclose(f);
+        }
+    }
+    MPI_Bcast(&len, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    if (len < 0) {
+        if (rank == 0) fprintf(stderr, "Ошибка: не удалось прочитать %s.\n", path);
+        free(text);
+        return EXIT_FAILURE;
+    }
+    if (rank != 0) text = malloc(len + 1);
+    sweep_conf_t *conf = malloc(SWEEP_MAX_CONF * sizeof(sweep_conf_t));
+    if (!text || !conf) {
+        fprintf(stderr, "Ошибка выделения памяти на rank %d.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Bcast(text, (int)len, MPI_CHAR, 0, MPI_COMM_WORLD);
+    text[len] = '\0';
+
+    /* Текст у всех процессов один, поэтому разбор и расписание совпадают. */
+    int nconf = 0, lineno = 0;
+    const char *err = NULL;
+    for (char *ln = text, *next; ln && !err; ln = next) {
+        next = strchr(ln, '\n');
+        if (next) *next++ = '\0';
+        ++lineno;
+        char *hash = strchr(ln, '#');
+        if (hash) *hash = '\0';
+        char *save, *tok = strtok_r(ln, " \t\r", &save);
+        if (!tok) continue;
+        if (nconf == SWEEP_MAX_CONF) {
+            err = "слишком много конфигураций";
+            break;
+        }
+        sweep_conf_t *c = &conf[nconf];
+        c->P = atoi(tok);
+        c->line = lineno;
+        c->round = -1;
+        c->nargs = 0;
+        while ((tok = strtok_r(NULL, " \t\r", &save))) {
+            if (c->nargs == SWEEP_MAX_ARGS) {
+                err = "слишком много параметров";
+                break;
+            }
+            c->args[c->nargs++] = tok;
+        }
+        if (c->P < 1 || c->P > size) err = "число процессов вне [1, размер MPI_COMM_WORLD]";
+        transport_opts_t o = *base;
+        transport_parse(&o, c->nargs, c->args);
+        c->cost = pow(o.M, o.D) * o.K * (o.ensemble > 0 ? o.ensemble : 1);
+        ++nconf;
+    }
+    if (err || nconf == 0) {
+        if (rank == 0 && err) fprintf(stderr, "Ошибка: %s, строка %d: %s.\n", path, lineno, err);
+        if (rank == 0 && !err) fprintf(stderr, "Ошибка: в %s нет ни одной конфигурации.\n", path);
+        free(conf);
+        free(text);
+        return EXIT_FAILURE;
+    }
+
+    qsort(conf, nconf, sizeof(*conf), sweep_cmp);
+    int nrounds = 0;
+    for (int done = 0; done < nconf; ++nrounds) {
+        int used = 0;
+        for (int i = 0; i < nconf; ++i) {
+            if (conf[i].round >= 0 || used + conf[i].P > size) continue;
+            conf[i].round = nrounds;
+            conf[i].first = used;
+            used += conf[i].P;
+            ++done;
+        }
+    }
+
+    int status = EXIT_SUCCESS;
+    double t_start = MPI_Wtime();
+    for (int r = 0; r < nrounds; ++r) {
+        int color = MPI_UNDEFINED;
+        for (int i = 0; i < nconf; ++i)
+            if (conf[i].round == r && rank >= conf[i].first && rank < conf[i].first + conf[i].P)
+                color = i;
+        MPI_Comm group;
+        MPI_Comm_split(MPI_COMM_WORLD, color, rank, &group);
+        if (group == MPI_COMM_NULL) continue;
+
+        sweep_conf_t *c = &conf[color];
+        transport_opts_t o = *base;
+        transport_parse(&o, c->nargs, c->args);
+        bench_t bench = *tmpl;
+        char out[SWEEP_MAX_PATH];
+        bench.out = sweep_bench_out(tmpl->out, &o, out, sizeof(out));
+        bench.comm = group;
+        if (rank == c->first) {
+            printf("Перебор: раунд %d, строка %d, P=%d:", r + 1, c->line, c->P);
+            for (int j = 0; j < c->nargs; ++j) printf(" %s", c->args[j]);
+            printf("\n");
+        }
+        PERF_COMM(group);
+        if (transport_run(group, &o, &bench, provided) != EXIT_SUCCESS) status = EXIT_FAILURE;
+        fflush(stdout);
+        MPI_Comm_free(&group);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (rank == 0)
+        printf("Перебор %s: конфигураций %d, раундов %d, общее время %.3f с\n",
+               path, nconf, nrounds, MPI_Wtime() - t_start);
+
+    free(conf);
+    free(text);
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    bench_t bench;
+    bench_init(&bench, "transport_mpi", &argc, argv);
+
+    /* --sweep забирается здесь; остальные параметры — общие для всех строк. */
+    const char *sweep_path = NULL;
+    int k = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--sweep=", 8) == 0) sweep_path = argv[i] + 8;
+        else argv[k++] = argv[i];
+    }
+    argc = k;
+    transport_opts_t opts;
+    transport_defaults(&opts);
+    transport_parse(&opts, argc - 1, argv + 1);
+
+    int status = sweep_path ? run_sweep(sweep_path, &opts, &bench, provided)
+                            : transport_run(MPI_COMM_WORLD, &opts, &bench, provided);
     MPI_Finalize();
-    return 0;
-} 
\ No newline at end of file
+    return status;
+}
@@ -14,13 +14,32 @@
  *   gcc -O2 -o transport_seq transport_seq.c -lm
  *
  * Запуск:
- *   ./transport_seq [M] [K]
+ *   ./transport_seq [M] [K] [--kernel=auto|scalar|avx2|avx512]
+ *                   [--tile=B] [--tdepth=S]
+ *                   [--ensemble=B] [--ensemble-params=FILE]
+ *                   [--reps=R] [--warmup=W] [--bench-out=FILE]
+ *
+ * Параметры:
+ *   --kernel  реализация ядра (по умолчанию выбирается по процессору)
+ *   --tile    ширина пространственного блока, 0 — без разбиения (4096)
+ *   --tdepth  число шагов по времени на блок (32)
+ *   --ensemble  решать B независимых задач с разными a, φ и источником
+ *             за один запуск (transport_ensemble.h); печатается суммарная
+ *             пропускная способность в обновлениях точек в секунду.
+ *             Разбиение на блоки в этом режиме не используется.
+ *   --reps, --warmup, --bench-out  повторы решения и запись статистики
+ *             (common/bench.h); печатается медиана времени
+ * Разбиение по времени применяется только при нулевом источнике.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
-#include <sys/time.h>
+#include <string.h>
+
+#include "transport_kernel.h"
+#include "transport_ensemble.h"
+#include "../../common/bench.h"
 
 // Параметры задачи
 static const double a = 1.0;   // скорость переноса
@@ -39,11 +58,137 @@ double psi(double t) {
 double f_src(double t, double x) {
     return 0.0;
 }
+// 1, если f_src тождественно равна нулю: слагаемое источника пропускается
+static const int f_src_zero = 1;
+
+/* --ensemble: B задач в чередующемся размещении, см. transport_ensemble.h. */
+static int run_ensemble(bench_t *bench, int M, int K, int B,
+                        const char *params_path, const char *kernel_name) {
+    const char *kernel_used;
+    leapfrog_ens_fn kern = leapfrog_ens_select(kernel_name, &kernel_used);
+    if (!kern) {
+        fprintf(stderr, "Ядро %s недоступно на этом процессоре.\n", kernel_name);
+        return EXIT_FAILURE;
+    }
+    ens_param_t *par = malloc(B * sizeof(ens_param_t));
+    double *lam = malloc(B * sizeof(double));
+    double *sq  = calloc(B, sizeof(double));
+    size_t n = (size_t)(M + 1) * B;
+    double *layer[3] = {calloc(n, sizeof(double)), calloc(n, sizeof(double)), calloc(n, sizeof(double))};
+    double *src = calloc(n, sizeof(double));
+    if (!par || !lam || !sq || !layer[0] || !layer[1] || !layer[2] || !src) {
+        fprintf(stderr, "Ошибка выделения памяти.\n");
+        return EXIT_FAILURE;
+    }
+    int rc = ens_params(par, B, params_path, a);
+    if (rc != 0) {
+        fprintf(stderr, rc == -1 ? "Ошибка: не удалось открыть %s.\n"
+                                 : "Ошибка: в %s меньше B строк «a k s».\n", params_path);
+        return EXIT_FAILURE;
+    }
+    double h = X / M;
+    double tau = T / K;
+    int with_src = 0;
+    double lam_max = 0.0;
+    for (int e = 0; e < B; ++e) {
+        if (par[e].s != 0.0) with_src = 1;
+        if (fabs(par[e].a * tau / h) > lam_max) lam_max = fabs(par[e].a * tau / h);
+    }
+    if (lam_max > 1.0) {
+        fprintf(stderr, "Внимание! Условие Куранта max λ=%.3f>1, схема может быть неустойчива.\n", lam_max);
+    }
+
+    bench_config(bench, "M", "%d", M);
+    bench_config(bench, "K", "%d", K);
+    bench_config(bench, "kernel", "%s", kernel_used);
+    bench_config(bench, "ensemble", "%d", B);
+    bench_config(bench, "params", "%s", params_path ? params_path : "default");
+
+    double *u_old = NULL, *u_cur = NULL, *u_new = NULL;
+    for (int r = 0; r < bench_runs(bench); ++r) {
+        u_old = layer[0];
+        u_cur = layer[1];
+        u_new = layer[2];
+        ens_init(par, B, M, h, tau, 0, 0, M + 1, lam, u_old, u_cur, src);
+
+        double t0 = bench_now();
+        for (int k = 1; k < K; ++k) {
+            /* ψ = 0: граничные точки всех экземпляров остаются нулевыми. */
+            memset(u_new, 0, B * sizeof(double));
+            memset(u_new + (size_t)M * B, 0, B * sizeof(double));
+            kern(u_new, u_old, u_cur, with_src ? src : NULL, lam, 2.0 * tau, B, 1, M);
+            double *tmp = u_old;
+            u_old = u_cur;
+            u_cur = u_new;
+            u_new = tmp;
+        }
+        bench_record(bench, r, bench_now() - t0);
+    }
+    double elapsed = bench_median(bench);
+    ens_sumsq(u_cur, B, 0, M + 1, sq);
+    double mean = 0.0;
+    for (int e = 0; e < B; ++e) mean += sqrt(h * sq[e]) / B;
+    double rate = (double)B * (M - 1) * (K - 1) / elapsed;
+
+    printf("Последовательная реализация, ансамбль:\n");
+    printf("  B=%d, M=%d, K=%d, max λ=%.3f, ядро=%s, параметры=%s\n",
+           B, M, K, lam_max, kernel_used, params_path ? params_path : "по умолчанию");
+    printf("  Время решения: %.6f с\n", elapsed);
+    printf("  Обновлений точек в секунду: %.3e\n", rate);
+    printf("  Норма решения (экземпляр 0): %.15e\n", sqrt(h * sq[0]));
+    printf("  Средняя норма по ансамблю: %.15e\n", mean);
+    bench_metric(bench, "norm", sqrt(h * sq[0]));
+    bench_metric(bench, "norm_mean", mean);
+    bench_metric(bench, "updates_per_s", rate);
+    bench_finish(bench);
+
+    free(layer[0]);
+    free(layer[1]);
+    free(layer[2]);
+    free(src);
+    free(par);
+    free(lam);
+    free(sq);
+    return 0;
+}
 
 int main(int argc, char *argv[]) {
+    bench_t bench;
+    bench_init(&bench, "transport_seq", &argc, argv);
     int M = 1000, K = 1000;
-    if (argc >= 2) M = atoi(argv[1]);
-    if (argc >= 3) K = atoi(argv[2]);
+    int tile = 4096, tdepth = 32;
+    int ensemble = 0;
+    const char *ens_path = NULL;
+    const char *kernel_name = "auto";
+    int npos = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--kernel=", 9) == 0) {
+            kernel_name = argv[i] + 9;
+        } else if (strncmp(argv[i], "--ensemble=", 11) == 0) {
+            ensemble = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--ensemble-params=", 18) == 0) {
+            ens_path = argv[i] + 18;
+        } else if (strncmp(argv[i], "--tile=", 7) == 0) {
+            tile = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--tdepth=", 9) == 0) {
+            tdepth = atoi(argv[i] + 9);
+        } else if (npos == 0) {
+            M = atoi(argv[i]); ++npos;
+        } else if (npos == 1) {
+            K = atoi(argv[i]); ++npos;
+        }
+    }
+    if (ensemble > 0) {
+        bench.name = "transport_seq_ens";
+        return run_ensemble(&bench, M, K, ensemble, ens_path, kernel_name);
+    }
+    const char *kernel_used;
+    leapfrog_fn kern = leapfrog_select(kernel_name, &kernel_used);
+    if (!kern) {
+        fprintf(stderr, "Ядро %s недоступно на этом процессоре.\n", kernel_name);
+        return EXIT_FAILURE;
+    }
+    if (tdepth < 1) tdepth = 1;
 
     double h = X / M;
     double tau = T / K;
@@ -55,56 +200,93 @@ int main(int argc, char *argv[]) {
     double *u_old = malloc((M+1) * sizeof(double));
     double *u_cur = malloc((M+1) * sizeof(double));
     double *u_new = malloc((M+1) * sizeof(double));
-    if (!u_old || !u_cur || !u_new) {
+    double *src   = malloc((M+1) * sizeof(double));
+    double *xs    = malloc((M+1) * sizeof(double));
+    double *bc    = malloc(tdepth * sizeof(double));
+    if (!u_old || !u_cur || !u_new || !src || !xs || !bc) {
         fprintf(stderr, "Ошибка выделения памяти.\n");
         return EXIT_FAILURE;
     }
 
-    for (int m = 0; m <= M; ++m) {
-        double x = m * h;
-        u_old[m] = phi(x);
-    }
-    u_old[0] = psi(0.0);
-    u_old[M] = 0.0;
-
-    u_cur[0] = psi(tau);
-    for (int m = 1; m < M; ++m) {
-        double x = m * h;
-        u_cur[m] = u_old[m]
-                   - lambda * (u_old[m] - u_old[m-1])
-                   + tau * f_src(0.0, x);
-    }
-    u_cur[M] = 0.0;
+    bench_config(&bench, "M", "%d", M);
+    bench_config(&bench, "K", "%d", K);
+    bench_config(&bench, "kernel", "%s", kernel_used);
+    bench_config(&bench, "tile", "%d", tile);
+    bench_config(&bench, "tdepth", "%d", tdepth);
 
-    struct timeval t0, t1;
-    gettimeofday(&t0, NULL);
+    // Слои меняются местами при счёте; каждый повтор начинает с исходных
+    double *layer[3] = {u_old, u_cur, u_new};
+    for (int r = 0; r < bench_runs(&bench); ++r) {
+        u_old = layer[0];
+        u_cur = layer[1];
+        u_new = layer[2];
+        for (int m = 0; m <= M; ++m) {
+            xs[m] = m * h;
+            u_old[m] = phi(xs[m]);
+        }
+        u_old[0] = psi(0.0);
+        u_old[M] = 0.0;
 
-    for (int k = 1; k < K; ++k) {
-        double t_k = k * tau;
-        double t_k1 = (k + 1) * tau;
-        u_new[0] = psi(t_k1);
-        u_new[M] = 0.0;
+        u_cur[0] = psi(tau);
         for (int m = 1; m < M; ++m) {
             double x = m * h;
-            u_new[m] = u_old[m]
-                       - lambda * (u_cur[m+1] - u_cur[m-1])
-                       + 2.0 * tau * f_src(t_k, x);
+            u_cur[m] = u_old[m]
+                       - lambda * (u_old[m] - u_old[m-1])
+                       + tau * f_src(0.0, x);
         }
-        double *tmp = u_old;
-        u_old = u_cur;
-        u_cur = u_new;
-        u_new = tmp;
+        u_cur[M] = 0.0;
+        u_new[M] = 0.0;
+
+        double t0 = bench_now();
+
+        if (f_src_zero && tile > 0) {
+            double *u[3] = {u_old, u_cur, u_new};
+            for (int k = 1; k < K; k += tdepth) {
+                int steps = (K - k < tdepth) ? K - k : tdepth;
+                for (int j = 0; j < steps; ++j) bc[j] = psi((k + 1 + j) * tau);
+                transport_advance_tiled(u, M, steps, tile, lambda, bc, kern);
+            }
+            u_old = u[0];
+            u_cur = u[1];
+            u_new = u[2];
+        } else {
+            for (int k = 1; k < K; ++k) {
+                double t_k = k * tau;
+                double t_k1 = (k + 1) * tau;
+                u_new[0] = psi(t_k1);
+                u_new[M] = 0.0;
+                if (!f_src_zero) {
+                    for (int m = 1; m < M; ++m) src[m] = f_src(t_k, xs[m]);
+                }
+                kern(u_new, u_old, u_cur, f_src_zero ? NULL : src,
+                     lambda, 2.0 * tau, 1, M);
+                double *tmp = u_old;
+                u_old = u_cur;
+                u_cur = u_new;
+                u_new = tmp;
+            }
+        }
+
+        bench_record(&bench, r, bench_now() - t0);
     }
+    double elapsed = bench_median(&bench);
 
-    gettimeofday(&t1, NULL);
-    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) * 1e-6;
+    double sq = 0.0;
+    for (int m = 0; m <= M; ++m) sq += u_cur[m] * u_cur[m];
 
     printf("Последовательная реализация:\n");
-    printf("  M=%d, K=%d, lambda=%.3f\n", M, K, lambda);
+    printf("  M=%d, K=%d, lambda=%.3f, ядро=%s, блок=%d×%d\n",
+           M, K, lambda, kernel_used, tile, tdepth);
     printf("  Время решения: %.6f с\n", elapsed);
+    printf("  Норма решения: %.15e\n", sqrt(h * sq));
+    bench_metric(&bench, "norm", sqrt(h * sq));
+    bench_finish(&bench);
 
-    free(u_old);
-    free(u_cur);
-    free(u_new);
+    free(layer[0]);
+    free(layer[1]);
+    free(layer[2]);
+    free(src);
+    free(xs);
+    free(bc);
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,136 @@
+/*
+ * Seedable, parallel input generation for the sort benchmarks.
+ *
+ *   datagen_fill_i32(a, first, count, n, dist, seed, nthreads)
+ *
+ * fills a[0..count) with elements first..first+count-1 of an n-element
+ * data set drawn from distribution `dist`:
+ *
+ *   uniform  independent keys in [0, INT_MAX] (what rand() gave)
+ *   sorted   increasing keys spread over [0, INT_MAX]
+ *   reverse  decreasing keys
+ *   nearly   sorted, with 1% of the keys replaced by uniform ones
+ *   few      DATAGEN_FEW distinct keys
+ *   equal    one key
+ *   zipf     Zipf(DATAGEN_ZIPF_S) ranks over DATAGEN_ZIPF_M values; the
+ *            ranks are hashed so frequent keys are scattered over the range
+ *
+ * Element i depends only on (seed, i): the random numbers come from a
+ * counter-based generator (splitmix64 finalizer of seed and counter), so
+ * the data is the same for any thread count and any split into chunks or
+ * ranks. Returns 0, or -1 for an unknown distribution.
+ */
+
+#ifndef DATAGEN_H
+#define DATAGEN_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#define DATAGEN_NAMES   "uniform|sorted|reverse|nearly|few|equal|zipf"
+#define DATAGEN_FEW     16
+#define DATAGEN_ZIPF_S  1.1
+#define DATAGEN_ZIPF_M  (1 << 20)
+
+enum { DG_UNIFORM, DG_SORTED, DG_REVERSE, DG_NEARLY, DG_FEW, DG_EQUAL, DG_ZIPF };
+
+static inline int datagen_dist(const char *name) {
+    static const char *names[] = {"uniform", "sorted", "reverse", "nearly", "few", "equal", "zipf"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); ++i)
+        if (strcmp(name, names[i]) == 0) return i;
+    return -1;
+}
+
+/* Random 64 bits number `stream` for element i. */
+static inline uint64_t datagen_rand(uint64_t seed, uint64_t i, unsigned stream) {
+    uint64_t z = seed * 0xD1B54A32D192ED03ull + i * 0x9E3779B97F4A7C15ull
+               + (uint64_t)stream * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline double datagen_unit(uint64_t r) {
+    return (r >> 11) * (1.0 / 9007199254740992.0);   /* [0, 1) */
+}
+
+/* Zipf by rejection-inversion (Hormann, Derflinger 1996). */
+static inline double datagen_h_int(double x) {
+    double lx = log(x), t = (1.0 - DATAGEN_ZIPF_S) * lx;
+    return (fabs(t) > 1e-8 ? expm1(t) / t : 1.0 + t / 2.0) * lx;
+}
+
+static inline double datagen_h_int_inv(double x) {
+    double t = x * (1.0 - DATAGEN_ZIPF_S);
+    if (t < -1.0) t = -1.0;
+    return exp((fabs(t) > 1e-8 ? log1p(t) / t : 1.0 - t / 2.0) * x);
+}
+
+static inline double datagen_h(double x) {
+    return exp(-DATAGEN_ZIPF_S * log(x));
+}
+
+static inline long datagen_zipf(uint64_t seed, uint64_t i) {
+    const double hx1 = datagen_h_int(1.5) - 1.0;
+    const double hn  = datagen_h_int(DATAGEN_ZIPF_M + 0.5);
+    const double sf  = 2.0 - datagen_h_int_inv(datagen_h_int(2.5) - datagen_h(2.0));
+    for (unsigned stream = 1; ; ++stream) {
+        double u = hn + datagen_unit(datagen_rand(seed, i, stream)) * (hx1 - hn);
+        double x = datagen_h_int_inv(u);
+        long k = (long)(x + 0.5);
+        if (k < 1) k = 1;
+        if (k > DATAGEN_ZIPF_M) k = DATAGEN_ZIPF_M;
+        if (k - x <= sf || u >= datagen_h_int(k + 0.5) - datagen_h((double)k)) return k;
+    }
+}
+
+static inline int32_t datagen_key(int dist, uint64_t seed, long i, long n) {
+    uint64_t r = datagen_rand(seed, (uint64_t)i, 0);
+    double pos = n > 1 ? (double)i / (double)(n - 1) : 0.0;
+    switch (dist) {
+    case DG_SORTED:  return (int32_t)(pos * 2147483647.0);
+    case DG_REVERSE: return (int32_t)((1.0 - pos) * 2147483647.0);
+    case DG_NEARLY:
+        if (r % 100 == 0) return (int32_t)(datagen_rand(seed, (uint64_t)i, 1) >> 33);
+        return (int32_t)(pos * 2147483647.0);
+    case DG_FEW:     return (int32_t)(datagen_rand(seed, r % DATAGEN_FEW, 2) >> 33);
+    case DG_EQUAL:   return 1 << 30;
+    case DG_ZIPF:    return (int32_t)(datagen_rand(seed, (uint64_t)datagen_zipf(seed, (uint64_t)i), 3) >> 33);
+    default:         return (int32_t)(r >> 33);
+    }
+}
+
+struct datagen_args {
+    int32_t *a;
+    long first, lo, hi, n;
+    int dist;
+    uint64_t seed;
+};
+
+static void *datagen_thread(void *arg) {
+    struct datagen_args *g = arg;
+    for (long j = g->lo; j < g->hi; ++j)
+        g->a[j] = datagen_key(g->dist, g->seed, g->first + j, g->n);
+    return NULL;
+}
+
+static inline int datagen_fill_i32(int32_t *a, long first, long count, long n,
+                                   const char *dist, uint64_t seed, int nthreads) {
+    int d = datagen_dist(dist);
+    if (d < 0) return -1;
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > 64) nthreads = 64;
+    pthread_t th[64];
+    struct datagen_args g[64];
+    for (int t = 0; t < nthreads; ++t) {
+        g[t] = (struct datagen_args){a, first, count * t / nthreads, count * (t + 1) / nthreads, n, d, seed};
+        if (t > 0) pthread_create(&th[t], NULL, datagen_thread, &g[t]);
+    }
+    datagen_thread(&g[0]);
+    for (int t = 1; t < nthreads; ++t) pthread_join(th[t], NULL);
+    return 0;
+}
+
+#endif /* DATAGEN_H */
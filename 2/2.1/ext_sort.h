@@ -0,0 +1,313 @@
+/*
+ * External (out-of-core) sort of a binary file of native-endian int32.
+ *
+ *   ext_sort_i32(in, out, tmpdir, mem_bytes, nthreads, &stats)
+ *
+ * Run formation: the input is mapped one window at a time, the window is
+ * copied into a buffer of mem_bytes/8 keys and sorted with radix_sort_i32
+ * on nthreads threads (which takes a second buffer of the same size), and
+ * the sorted run is appended to a temporary file in tmpdir.
+ *
+ * Merge: up to `fan-in` runs are merged with a loser tree. Every input
+ * run and the output get two blocks: the merge works on one while POSIX
+ * aio fills (or drains) the other. The fan-in is the largest that keeps
+ * all 2*(fan-in + 1) blocks at least EXT_MIN_BLOCK keys within mem_bytes;
+ * with more runs than that, intermediate passes ping-pong between two
+ * temporary files and the last pass writes the output.
+ *
+ * Returns 0 on success and -1 (after a message on stderr) on failure.
+ */
+
+#ifndef EXT_SORT_H
+#define EXT_SORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <aio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "radix_sort.h"
+
+#define EXT_MIN_BLOCK (16 * 1024)   /* keys per I/O block */
+
+struct ext_sort_stats {
+    long n;
+    int runs, passes;
+    double run_time, merge_time;
+};
+
+static double ext_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int ext_fail(const char *what, const char *path) {
+    fprintf(stderr, "ext_sort: %s %s: %s\n", what, path ? path : "", strerror(errno));
+    return -1;
+}
+
+/* Waits for a submitted aio request; returns its byte count or -1. */
+static ssize_t ext_aio_wait(struct aiocb *cb) {
+    const struct aiocb *list[1] = {cb};
+    int err;
+    while ((err = aio_error(cb)) == EINPROGRESS) aio_suspend(list, 1, NULL);
+    ssize_t r = aio_return(cb);
+    if (err) errno = err;
+    return err ? -1 : r;
+}
+
+static int ext_aio_submit(struct aiocb *cb, int fd, void *buf, size_t bytes, off_t off, int write) {
+    memset(cb, 0, sizeof(*cb));
+    cb->aio_fildes = fd;
+    cb->aio_buf    = buf;
+    cb->aio_nbytes = bytes;
+    cb->aio_offset = off;
+    return write ? aio_write(cb) : aio_read(cb);
+}
+
+/* One input run: two blocks, the inactive one being filled by aio. */
+struct ext_reader {
+    int32_t *buf[2];
+    long n[2], pos, next, left;   /* next/left: file position and keys not yet requested */
+    int cur, pending, fd;
+    struct aiocb cb;
+};
+
+static int ext_reader_request(struct ext_reader *r, int slot, long block) {
+    long k = r->left < block ? r->left : block;
+    r->pending = 0;
+    if (k == 0) return 0;
+    if (ext_aio_submit(&r->cb, r->fd, r->buf[slot], k * sizeof(int32_t),
+                       (off_t)r->next * sizeof(int32_t), 0) != 0)
+        return ext_fail("aio_read", NULL);
+    r->next += k;
+    r->left -= k;
+    r->pending = 1;
+    return 0;
+}
+
+/* Makes buf[cur][pos] valid; 1 if the run is exhausted, -1 on error. */
+static int ext_reader_refill(struct ext_reader *r, long block) {
+    if (!r->pending) return 1;
+    ssize_t got = ext_aio_wait(&r->cb);
+    if (got < 0) return ext_fail("aio_read", NULL);
+    if ((size_t)got != r->cb.aio_nbytes) { errno = EIO; return ext_fail("short read", NULL); }
+    r->cur ^= 1;
+    r->n[r->cur] = got / sizeof(int32_t);
+    r->pos = 0;
+    return ext_reader_request(r, r->cur ^ 1, block);
+}
+
+struct ext_writer {
+    int32_t *buf[2];
+    long n, off;
+    int cur, pending, fd;
+    struct aiocb cb;
+};
+
+static int ext_writer_flush(struct ext_writer *w) {
+    if (w->pending) {
+        ssize_t put = ext_aio_wait(&w->cb);
+        if (put < 0 || (size_t)put != w->cb.aio_nbytes) return ext_fail("aio_write", NULL);
+        w->pending = 0;
+    }
+    if (w->n == 0) return 0;
+    if (ext_aio_submit(&w->cb, w->fd, w->buf[w->cur], w->n * sizeof(int32_t),
+                       (off_t)w->off * sizeof(int32_t), 1) != 0)
+        return ext_fail("aio_write", NULL);
+    w->pending = 1;
+    w->off += w->n;
+    w->n = 0;
+    w->cur ^= 1;
+    return 0;
+}
+
+/* Is run a's head before run b's? Exhausted runs lose, ties go to the lower run. */
+static inline int ext_before(const struct ext_reader *rd, const char *done, int a, int b) {
+    if (done[a]) return 0;
+    if (done[b]) return 1;
+    int32_t ka = rd[a].buf[rd[a].cur][rd[a].pos], kb = rd[b].buf[rd[b].cur][rd[b].pos];
+    return ka < kb || (ka == kb && a < b);
+}
+
+/*
+ * Merges k runs of in_fd (start[i], len[i] in keys) into out_fd from key
+ * offset out_off, with blocks of `block` keys taken from `mem`.
+ */
+static int ext_merge(int in_fd, const long *start, const long *len, int k,
+                     int out_fd, long out_off, int32_t *mem, long block) {
+    int K = 1;
+    while (K < k) K *= 2;
+    struct ext_reader *rd = calloc(K, sizeof(*rd));
+    char *done = malloc(K);
+    int *tree = malloc(K * sizeof(int));
+    int *win = malloc(2 * K * sizeof(int));
+    int rc = -1;
+    if (!rd || !done || !tree || !win) { ext_fail("malloc", NULL); goto out; }
+
+    for (int i = 0; i < K; ++i) {
+        done[i] = 1;
+        if (i >= k) continue;
+        struct ext_reader *r = &rd[i];
+        r->buf[0] = mem + (2 * i) * block;
+        r->buf[1] = r->buf[0] + block;
+        r->fd = in_fd;
+        r->next = start[i];
+        r->left = len[i];
+        r->cur = 1;
+        if (ext_reader_request(r, 0, block) != 0) goto out;
+        int s = ext_reader_refill(r, block);
+        if (s < 0) goto out;
+        done[i] = (char)s;
+    }
+    struct ext_writer w = {{mem + 2 * k * block, mem + (2 * k + 1) * block}, 0, out_off, 0, 0, out_fd, {0}};
+
+    /* Loser tree: internal nodes 1..K-1 hold the losers, tree[0] the winner. */
+    for (int i = 0; i < K; ++i) win[K + i] = i;
+    for (int i = K - 1; i >= 1; --i) {
+        int l = win[2 * i], r = win[2 * i + 1];
+        if (ext_before(rd, done, l, r)) { win[i] = l; tree[i] = r; }
+        else                            { win[i] = r; tree[i] = l; }
+    }
+    tree[0] = win[1];
+
+    while (!done[tree[0]]) {
+        int x = tree[0];
+        struct ext_reader *r = &rd[x];
+        w.buf[w.cur][w.n++] = r->buf[r->cur][r->pos++];
+        if (w.n == block && ext_writer_flush(&w) != 0) goto out;
+        if (r->pos == r->n[r->cur]) {
+            int s = ext_reader_refill(r, block);
+            if (s < 0) goto out;
+            done[x] = (char)s;
+        }
+        for (int node = (x + K) / 2; node >= 1; node /= 2) {
+            if (ext_before(rd, done, tree[node], x)) {
+                int t = tree[node]; tree[node] = x; x = t;
+            }
+        }
+        tree[0] = x;
+    }
+    if (ext_writer_flush(&w) != 0 || ext_writer_flush(&w) != 0) goto out;
+    rc = 0;
+out:
+    free(rd);
+    free(done);
+    free(tree);
+    free(win);
+    return rc;
+}
+
+static int ext_sort_i32(const char *in, const char *out, const char *tmpdir,
+                        size_t mem_bytes, int nthreads, struct ext_sort_stats *st) {
+    memset(st, 0, sizeof(*st));
+    int in_fd = open(in, O_RDONLY);
+    if (in_fd < 0) return ext_fail("open", in);
+    struct stat sb;
+    if (fstat(in_fd, &sb) != 0) { close(in_fd); return ext_fail("stat", in); }
+    long n = sb.st_size / (long)sizeof(int32_t);
+    st->n = n;
+
+    long page = sysconf(_SC_PAGESIZE) / (long)sizeof(int32_t);
+    long run = (long)(mem_bytes / (2 * sizeof(int32_t))) / page * page;
+    if (run < page) run = page;
+    long fan_in = (long)(mem_bytes / (EXT_MIN_BLOCK * sizeof(int32_t))) / 2 - 1;
+    if (fan_in < 2) {
+        fprintf(stderr, "ext_sort: memory bound %zu bytes is below the minimum %zu\n",
+                mem_bytes, (size_t)6 * EXT_MIN_BLOCK * sizeof(int32_t));
+        close(in_fd);
+        return -1;
+    }
+
+    char tmp[2][4096];
+    snprintf(tmp[0], sizeof(tmp[0]), "%s/ext_runs.0", tmpdir);
+    snprintf(tmp[1], sizeof(tmp[1]), "%s/ext_runs.1", tmpdir);
+    int fd[2] = {-1, -1}, out_fd = -1, rc = -1;
+    int32_t *buf = NULL;
+    long nruns = n ? (n + run - 1) / run : 0;
+    long *start = malloc((nruns + 1) * sizeof(long));
+    long *len = malloc((nruns + 1) * sizeof(long));
+    if (!start || !len) { ext_fail("malloc", NULL); goto out; }
+    for (int i = 0; i < 2; ++i) {
+        fd[i] = open(tmp[i], O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd[i] < 0) { ext_fail("open", tmp[i]); goto out; }
+    }
+    out_fd = open(out, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) { ext_fail("open", out); goto out; }
+
+    /* Run formation. */
+    double t0 = ext_now();
+    buf = malloc(run * sizeof(int32_t));
+    if (!buf) { ext_fail("malloc", NULL); goto out; }
+    for (long r = 0; r < nruns; ++r) {
+        start[r] = r * run;
+        len[r] = n - start[r] < run ? n - start[r] : run;
+        size_t bytes = len[r] * sizeof(int32_t);
+        void *map = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, in_fd, (off_t)start[r] * sizeof(int32_t));
+        if (map == MAP_FAILED) { ext_fail("mmap", in); goto out; }
+        madvise(map, bytes, MADV_SEQUENTIAL);
+        memcpy(buf, map, bytes);
+        munmap(map, bytes);
+        if (radix_sort_i32(buf, len[r], nthreads) != 0) { ext_fail("radix_sort", NULL); goto out; }
+        if (pwrite(fd[0], buf, bytes, (off_t)start[r] * sizeof(int32_t)) != (ssize_t)bytes) {
+            ext_fail("write", tmp[0]);
+            goto out;
+        }
+    }
+    free(buf);
+    buf = NULL;
+    st->runs = (int)nruns;
+    double t1 = ext_now();
+    st->run_time = t1 - t0;
+
+    /* Merge passes; each writes its output runs contiguously in run order. */
+    int src = 0;
+    do {
+        long groups = (nruns + fan_in - 1) / fan_in;
+        long k_max = nruns < fan_in ? nruns : fan_in;
+        long block = (long)(mem_bytes / sizeof(int32_t)) / (2 * (k_max + 1));
+        buf = malloc(2 * (k_max + 1) * block * sizeof(int32_t));
+        if (!buf) { ext_fail("malloc", NULL); goto out; }
+        int dst_fd = groups <= 1 ? out_fd : fd[src ^ 1];
+        long off = 0;
+        for (long g = 0; g < groups; ++g) {
+            long first = g * fan_in;
+            int k = (int)(nruns - first < fan_in ? nruns - first : fan_in);
+            if (ext_merge(fd[src], start + first, len + first, k, dst_fd, off, buf, block) != 0) goto out;
+            long total = 0;
+            for (int i = 0; i < k; ++i) total += len[first + i];
+            start[g] = off;
+            len[g] = total;
+            off += total;
+        }
+        free(buf);
+        buf = NULL;
+        nruns = groups;
+        src ^= 1;
+        st->passes++;
+    } while (nruns > 1);
+    if (n == 0 && ftruncate(out_fd, 0) != 0) { ext_fail("truncate", out); goto out; }
+    if (fsync(out_fd) != 0) { ext_fail("fsync", out); goto out; }
+    st->merge_time = ext_now() - t1;
+    rc = 0;
+out:
+    free(buf);
+    free(start);
+    free(len);
+    for (int i = 0; i < 2; ++i) {
+        if (fd[i] >= 0) close(fd[i]);
+        unlink(tmp[i]);
+    }
+    if (out_fd >= 0) close(out_fd);
+    close(in_fd);
+    return rc;
+}
+
+#endif /* EXT_SORT_H */
@@ -0,0 +1,302 @@
+/*
+ * Compilation:
+ *    mpicc -O2 -o mpi_sort mpi_sort.c -lm
+ *
+ * Usage:
+ *    mpirun -np P ./mpi_sort N [--dist=D] [--algo=qsort|radix] [--seed=S]
+ *                              [--reps=R] [--warmup=W] [--bench-out=FILE]
+ *
+ * Sample sort of N keys per rank (weak scaling). The input is one data
+ * set of N*P keys from datagen.h, rank r holding keys r*N..(r+1)*N-1, so
+ * e.g. --dist=sorted is globally sorted and --dist=reverse sends every
+ * key across the machine.
+ *
+ *   1. every rank sorts its keys (qsort or radix_sort_i32);
+ *   2. every rank takes OVERSAMPLE*P regular samples, the samples are
+ *      gathered everywhere and P-1 splitters picked from them;
+ *   3. each rank cuts its sorted keys at the splitters and sends piece i
+ *      to rank i in one MPI_Alltoallv;
+ *   4. the P received sorted pieces are merged with a heap.
+ * Samples and splitters are (key, rank, index) triples, compared in that
+ * order, so equal keys are split between ranks like distinct ones and
+ * duplicate-heavy inputs stay balanced.
+ *
+ * The result is checked: every rank's output is sorted, the last key of
+ * each nonempty rank is not above the first key of the next one, and the
+ * key count and sum are preserved. Rank 0 prints one line with the
+ * slowest rank's times and the load imbalance (max / mean keys); with
+ * --reps the time is the median over repetitions (bench.h) and the phase
+ * times are those of the repetition closest to it.
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "radix_sort.h"
+#include "datagen.h"
+#include "../../common/bench.h"
+
+#define OVERSAMPLE 32
+
+typedef struct {
+    int key, rank;
+    long idx;
+} Sample;
+
+int cmp_int(const void *a, const void *b) {
+    int ai = *(const int*)a;
+    int bi = *(const int*)b;
+    return (ai > bi) - (ai < bi);
+}
+
+static int cmp_sample(const void *a, const void *b) {
+    const Sample *x = a, *y = b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    if (x->rank != y->rank) return x->rank - y->rank;
+    return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+static long lower_bound(const int *a, long lo, long hi, int v) {
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (a[mid] < v) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static long upper_bound(const int *a, long lo, long hi, int v) {
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (a[mid] <= v) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Number of local keys (key, rank, j) below splitter s. */
+static long cut(const int *a, long n, int rank, const Sample *s) {
+    long lo = lower_bound(a, 0, n, s->key);
+    long hi = upper_bound(a, lo, n, s->key);
+    if (rank < s->rank) return hi;
+    if (rank > s->rank) return lo;
+    return s->idx < lo ? lo : s->idx > hi ? hi : s->idx;
+}
+
+/* Merges P sorted pieces of in (counts/displs) into out. */
+static void merge_pieces(const int *in, const int *counts, const int *displs, int P, int *out) {
+    long *cur = malloc(2 * P * sizeof(long));
+    long *end = cur + P;
+    int *heap = malloc(P * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < P; ++i) {
+        cur[i] = displs[i];
+        end[i] = (long)displs[i] + counts[i];
+        if (cur[i] == end[i]) continue;
+        int j = n++;
+        while (j > 0 && in[cur[heap[(j - 1) / 2]]] > in[cur[i]]) {
+            heap[j] = heap[(j - 1) / 2];
+            j = (j - 1) / 2;
+        }
+        heap[j] = i;
+    }
+    while (n > 1) {
+        int r = heap[0];
+        *out++ = in[cur[r]++];
+        if (cur[r] == end[r]) r = heap[--n];
+        int key = in[cur[r]];
+        int j = 0;
+        for (;;) {
+            int c = 2 * j + 1;
+            if (c >= n) break;
+            if (c + 1 < n && in[cur[heap[c + 1]]] < in[cur[heap[c]]]) ++c;
+            if (in[cur[heap[c]]] >= key) break;
+            heap[j] = heap[c];
+            j = c;
+        }
+        heap[j] = r;
+    }
+    if (n == 1) {
+        int r = heap[0];
+        memcpy(out, in + cur[r], (end[r] - cur[r]) * sizeof(int));
+    }
+    free(heap);
+    free(cur);
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    int rank, P;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &P);
+    bench_t bench;
+    bench_init(&bench, "mpi_sort", &argc, argv);
+
+    long N = 1000000;
+    const char *dist = "uniform";
+    int radix = 0;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--dist=", 7) == 0) {
+            dist = argv[i] + 7;
+            if (datagen_dist(dist) < 0) {
+                if (rank == 0) fprintf(stderr, "unknown distribution: %s (" DATAGEN_NAMES ")\n", dist);
+                MPI_Finalize();
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--algo=", 7) == 0) {
+            if (strcmp(argv[i] + 7, "radix") == 0) radix = 1;
+            else if (strcmp(argv[i] + 7, "qsort") == 0) radix = 0;
+            else {
+                if (rank == 0) fprintf(stderr, "unknown algorithm: %s\n", argv[i] + 7);
+                MPI_Finalize();
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoull(argv[i] + 7, NULL, 10);
+        } else {
+            N = atol(argv[i]);
+        }
+    }
+    /* MPI_Alltoallv counts are int. */
+    if (N < 1 || N > 2147483647L / 2) {
+        if (rank == 0) fprintf(stderr, "usage: %s N [--dist=" DATAGEN_NAMES "] [--algo=qsort|radix] [--seed=S]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    bench_config(&bench, "N", "%ld", N);
+    bench_config(&bench, "algo", "%s", radix ? "radix" : "qsort");
+    bench_config(&bench, "dist", "%s", dist);
+    bench_config(&bench, "seed", "%llu", (unsigned long long)seed);
+
+    int *a = malloc(N * sizeof(int));
+    if (!a) { fprintf(stderr, "malloc failed N=%ld\n", N); MPI_Abort(MPI_COMM_WORLD, 1); }
+    int s = OVERSAMPLE * P;
+    Sample *mine = malloc(s * sizeof(Sample));
+    Sample *all = malloc((size_t)s * P * sizeof(Sample));
+    MPI_Datatype sample_type;
+    MPI_Type_contiguous((int)sizeof(Sample), MPI_BYTE, &sample_type);
+    MPI_Type_commit(&sample_type);
+    int *scounts = malloc(4 * P * sizeof(int));
+    int *sdispls = scounts + P, *rcounts = scounts + 2 * P, *rdispls = scounts + 3 * P;
+    int *recv = NULL, *out = NULL;
+    long M = 0;
+    long long sum_in = 0;
+    double *phases = malloc(4 * bench_runs(&bench) * sizeof(double));
+
+    for (int rep = 0; rep < bench_runs(&bench); ++rep) {
+        datagen_fill_i32((int32_t *)a, (long)rank * N, N, (long)P * N, dist, seed, 1);
+        sum_in = 0;
+        for (long i = 0; i < N; ++i) sum_in += a[i];
+
+        double t[5];
+        MPI_Barrier(MPI_COMM_WORLD);
+        t[0] = MPI_Wtime();
+
+        /* 1. Local sort. */
+        if (radix) {
+            if (radix_sort_i32((int32_t *)a, N, 1) != 0) { fprintf(stderr, "malloc failed N=%ld\n", N); MPI_Abort(MPI_COMM_WORLD, 1); }
+        } else {
+            qsort(a, N, sizeof(int), cmp_int);
+        }
+        t[1] = MPI_Wtime();
+
+        /* 2. Regular samples and splitters. */
+        for (int i = 0; i < s; ++i) {
+            long idx = (long)((2.0 * i + 1) * N / (2.0 * s));
+            mine[i] = (Sample){a[idx], rank, idx};
+        }
+        MPI_Allgather(mine, s, sample_type, all, s, sample_type, MPI_COMM_WORLD);
+        qsort(all, (size_t)s * P, sizeof(Sample), cmp_sample);
+
+        /* 3. Partition and exchange. */
+        long prev = 0;
+        for (int i = 0; i < P; ++i) {
+            long c = i == P - 1 ? N : cut(a, N, rank, &all[(long)(i + 1) * s]);
+            sdispls[i] = (int)prev;
+            scounts[i] = (int)(c - prev);
+            prev = c;
+        }
+        MPI_Alltoall(scounts, 1, MPI_INT, rcounts, 1, MPI_INT, MPI_COMM_WORLD);
+        M = 0;
+        for (int i = 0; i < P; ++i) {
+            if (M + rcounts[i] > 2147483647L) { fprintf(stderr, "rank %d receives more than INT_MAX keys\n", rank); MPI_Abort(MPI_COMM_WORLD, 1); }
+            rdispls[i] = (int)M;
+            M += rcounts[i];
+        }
+        free(recv);
+        free(out);
+        recv = malloc((M ? M : 1) * sizeof(int));
+        out = malloc((M ? M : 1) * sizeof(int));
+        if (!recv || !out) { fprintf(stderr, "malloc failed M=%ld\n", M); MPI_Abort(MPI_COMM_WORLD, 1); }
+        MPI_Alltoallv(a, scounts, sdispls, MPI_INT, recv, rcounts, rdispls, MPI_INT, MPI_COMM_WORLD);
+        t[2] = MPI_Wtime();
+
+        /* 4. Merge the received pieces. */
+        merge_pieces(recv, rcounts, rdispls, P, out);
+        t[3] = MPI_Wtime();
+        t[4] = t[3] - t[0];
+
+        double phase[4] = {t[1] - t[0], t[2] - t[1], t[3] - t[2], t[4]};
+        MPI_Allreduce(phase, phases + 4 * rep, 4, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        bench_record(&bench, rep, phases[4 * rep + 3]);
+    }
+
+    /* Check. */
+    int ok = 1;
+    long long sum_out = 0;
+    for (long i = 0; i < M; ++i) {
+        if (i > 0 && out[i - 1] > out[i]) ok = 0;
+        sum_out += out[i];
+    }
+    long edge[3] = {M, M ? out[0] : 0, M ? out[M - 1] : 0};
+    long *edges = malloc(3 * P * sizeof(long));
+    MPI_Allgather(edge, 3, MPI_LONG, edges, 3, MPI_LONG, MPI_COMM_WORLD);
+    long last = 0;
+    int seen = 0;
+    for (int i = 0; i < P; ++i) {
+        if (edges[3 * i] == 0) continue;
+        if (seen && last > edges[3 * i + 1]) ok = 0;
+        last = edges[3 * i + 2];
+        seen = 1;
+    }
+    long long sums[2] = {sum_in, sum_out}, gsums[2];
+    MPI_Allreduce(sums, gsums, 2, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    long total = 0, Mmax = 0;
+    for (int i = 0; i < P; ++i) {
+        total += edges[3 * i];
+        if (edges[3 * i] > Mmax) Mmax = edges[3 * i];
+    }
+    if (total != N * P || gsums[0] != gsums[1]) ok = 0;
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+
+    double tmed = bench_median(&bench);
+    const double *tmax = phases + 4 * bench.warmup;
+    for (int rep = bench.warmup; rep < bench_runs(&bench); ++rep)
+        if (fabs(phases[4 * rep + 3] - tmed) < fabs(tmax[3] - tmed)) tmax = phases + 4 * rep;
+    bench_metric(&bench, "local", tmax[0]);
+    bench_metric(&bench, "exchange", tmax[1]);
+    bench_metric(&bench, "merge", tmax[2]);
+    bench_metric(&bench, "imbalance", (double)Mmax * P / (double)total);
+    if (rank == 0) {
+        printf("mpi_sort   N=%ld P=%d time=%.6f dist=%s algo=%s local=%.6f exchange=%.6f merge=%.6f imbalance=%.3f\n",
+               N, P, tmed, dist, radix ? "radix" : "qsort", tmax[0], tmax[1], tmax[2],
+               (double)Mmax * P / (double)total);
+        if (!all_ok) fprintf(stderr, "result not globally sorted\n");
+    }
+    bench_finish(&bench);
+
+    MPI_Type_free(&sample_type);
+    free(a);
+    free(mine);
+    free(all);
+    free(scounts);
+    free(recv);
+    free(out);
+    free(edges);
+    free(phases);
+    MPI_Finalize();
+    return all_ok ? 0 : 1;
+}
@@ -1,8 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 #include <string.h>
 #include <pthread.h>
+#include <limits.h>
+#include <stdint.h>
+#include "radix_sort.h"
+#include "ext_sort.h"
+#include "datagen.h"
+#include "../../common/bench.h"
+#include "../../common/perfctr.h"
+#include "../../common/placement.h"
+
+/* Counter regions, built with -DPERF_REGIONS (see common/perfctr.h). */
+enum { R_SORT, R_MERGE, NREGIONS };
+static const char *region_names[NREGIONS] = {"sort", "merge"};
 
 int cmp_int(const void *a, const void *b) {
     int ai = *(const int*)a;
@@ -10,35 +21,294 @@ int cmp_int(const void *a, const void *b) {
     return (ai > bi) - (ai < bi);
 }
 
+static place_t place;
+
+/* Radix workers are placed like the chunk-sort and merge workers. */
+static void radix_bind(int tid) {
+    place_bind(&place, tid);
+}
+
 struct sort_args {
     int *arr;
     long start, end;
+    int id;
 };
 
 void *thread_sort(void *arg) {
     struct sort_args *a = arg;
+    place_bind(&place, a->id);
+    PERF_THREAD(a->id);
+    PERF_BEGIN(R_SORT);
     qsort(a->arr + a->start, a->end - a->start, sizeof(int), cmp_int);
+    PERF_END(R_SORT);
     return NULL;
 }
 
+/*
+ * Parallel P-way merge. The sorted runs are cut at global ranks
+ * t*N/P (t = 0..P), so thread t owns output slice [rank_t, rank_{t+1})
+ * and merges the matching pieces of every run into it independently.
+ */
+
+struct merge_args {
+    const int *arr;
+    int *out;
+    const struct sort_args *runs;
+    int P, id;
+    long rank_lo, rank_hi;
+};
+
+static long lower_bound(const int *a, long lo, long hi, long v) {
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (a[mid] < v) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static long upper_bound(const int *a, long lo, long hi, long v) {
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (a[mid] <= v) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Multi-sequence selection: split[i] is the cut in run i such that the
+ * cuts hold exactly `rank` elements in total and nothing left of a cut
+ * is greater than anything right of any cut. Binary search on the key
+ * value, then ties are handed out in run order.
+ */
+static void select_splits(const int *arr, const struct sort_args *runs, int P,
+                          long rank, long *split) {
+    long lo = INT_MIN, hi = INT_MAX;
+    while (lo < hi) {
+        long v = lo + (hi - lo) / 2;
+        long cnt = 0;
+        for (int i = 0; i < P; ++i)
+            cnt += upper_bound(arr, runs[i].start, runs[i].end, v) - runs[i].start;
+        if (cnt >= rank) hi = v; else lo = v + 1;
+    }
+    long need = rank;
+    for (int i = 0; i < P; ++i) {
+        split[i] = lower_bound(arr, runs[i].start, runs[i].end, lo);
+        need -= split[i] - runs[i].start;
+    }
+    for (int i = 0; i < P && need > 0; ++i) {
+        long eq = upper_bound(arr, split[i], runs[i].end, lo) - split[i];
+        long take = eq < need ? eq : need;
+        split[i] += take;
+        need -= take;
+    }
+}
+
+void *thread_merge(void *arg) {
+    struct merge_args *m = arg;
+    int P = m->P;
+    place_bind(&place, m->id);
+    PERF_THREAD(m->id);
+    PERF_BEGIN(R_MERGE);
+    long *cur = malloc(2 * P * sizeof(long));
+    long *end = cur + P;
+    if (m->rank_lo == 0) {
+        for (int i = 0; i < P; ++i) cur[i] = m->runs[i].start;
+    } else {
+        select_splits(m->arr, m->runs, P, m->rank_lo, cur);
+    }
+    select_splits(m->arr, m->runs, P, m->rank_hi, end);
+
+    /* Binary min-heap of run indices keyed by the run's current head. */
+    int *heap = malloc(P * sizeof(int));
+    int n = 0;
+    const int *a = m->arr;
+    for (int i = 0; i < P; ++i) {
+        if (cur[i] == end[i]) continue;
+        int j = n++;
+        while (j > 0 && a[cur[heap[(j - 1) / 2]]] > a[cur[i]]) {
+            heap[j] = heap[(j - 1) / 2];
+            j = (j - 1) / 2;
+        }
+        heap[j] = i;
+    }
+
+    int *out = m->out + m->rank_lo;
+    while (n > 1) {
+        int r = heap[0];
+        *out++ = a[cur[r]++];
+        if (cur[r] == end[r]) r = heap[--n];
+        int key = a[cur[r]];
+        int j = 0;
+        for (;;) {
+            int c = 2 * j + 1;
+            if (c >= n) break;
+            if (c + 1 < n && a[cur[heap[c + 1]]] < a[cur[heap[c]]]) ++c;
+            if (a[cur[heap[c]]] >= key) break;
+            heap[j] = heap[c];
+            j = c;
+        }
+        heap[j] = r;
+    }
+    if (n == 1) {
+        int r = heap[0];
+        memcpy(out, a + cur[r], (end[r] - cur[r]) * sizeof(int));
+    }
+    free(heap);
+    free(cur);
+    PERF_END(R_MERGE);
+    return NULL;
+}
+
+/*
+ * --external: sorts a file of int32 with at most mem_mb MiB of buffers.
+ * Without --in, N keys of the chosen distribution are first written to
+ * tmpdir/ext_input.bin;
+ * without --out the result goes to tmpdir/ext_sorted.bin. Generated files
+ * are removed after the output has been checked.
+ */
+static int run_external(bench_t *bench, long N, int P, long mem_mb, const char *in, const char *out,
+                        const char *tmpdir, const char *dist, uint64_t seed) {
+    char gen_in[4096], gen_out[4096];
+    snprintf(gen_in, sizeof(gen_in), "%s/ext_input.bin", tmpdir);
+    snprintf(gen_out, sizeof(gen_out), "%s/ext_sorted.bin", tmpdir);
+    if (!in) {
+        FILE *f = fopen(gen_in, "wb");
+        if (!f) { perror(gen_in); return 1; }
+        enum { CHUNK = 1 << 20 };
+        int32_t *chunk = malloc(CHUNK * sizeof(int32_t));
+        for (long i = 0; i < N; i += CHUNK) {
+            long k = N - i < CHUNK ? N - i : CHUNK;
+            datagen_fill_i32(chunk, i, k, N, dist, seed, P);
+            if (fwrite(chunk, sizeof(int32_t), k, f) != (size_t)k) { perror(gen_in); fclose(f); free(chunk); return 1; }
+        }
+        free(chunk);
+        fclose(f);
+    }
+    const char *src = in ? in : gen_in;
+    const char *dst = out ? out : gen_out;
+
+    struct ext_sort_stats st;
+    for (int r = 0; r < bench_runs(bench); ++r) {
+        double t0 = bench_now();
+        if (ext_sort_i32(src, dst, tmpdir, (size_t)mem_mb << 20, P, &st) != 0) return 1;
+        bench_record(bench, r, bench_now() - t0);
+    }
+    double t = bench_median(bench);
+    printf("ext_sort   N=%ld P=%d time=%.6f mem=%ldMiB runs=%d passes=%d "
+           "run_time=%.3f merge_time=%.3f MBps=%.1f\n",
+           st.n, P, t, mem_mb, st.runs, st.passes, st.run_time, st.merge_time,
+           st.n * sizeof(int) / t / 1e6);
+    bench_metric(bench, "runs", st.runs);
+    bench_metric(bench, "passes", st.passes);
+    bench_finish(bench);
+
+    int rc = 0;
+    int fd = open(dst, O_RDONLY);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) != 0 || sb.st_size != st.n * (long)sizeof(int)) {
+        fprintf(stderr, "output %s has the wrong size\n", dst);
+        rc = 1;
+    } else if (st.n > 0) {
+        const int *r = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (r == MAP_FAILED) { perror(dst); rc = 1; }
+        else {
+            for (long i = 1; i < st.n && rc == 0; ++i) {
+                if (r[i - 1] > r[i]) {
+                    fprintf(stderr, "result not sorted at %ld\n", i);
+                    rc = 1;
+                }
+            }
+            munmap((void *)r, sb.st_size);
+        }
+    }
+    if (fd >= 0) close(fd);
+    if (!in)  unlink(gen_in);
+    if (!out) unlink(gen_out);
+    return rc;
+}
+
 int main(int argc, char **argv) {
+    bench_t bench;
+    bench_init(&bench, "par_sort", &argc, argv);
+    int bad_place = place_init(&place, &argc, argv);
     long N = 1000000;
     int P = 4;
-    if (argc >= 2) N = atol(argv[1]);
-    if (argc >= 3) P = atoi(argv[2]);
+    int serial_merge = 0;
+    int radix = 0;
+    int external = 0;
+    long mem_mb = 256;
+    const char *ext_in = NULL, *ext_out = NULL, *tmpdir = ".";
+    const char *dist = "uniform";
+    uint64_t seed = 1;
+    int pos = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--external") == 0) external = 1;
+        else if (strncmp(argv[i], "--dist=", 7) == 0) {
+            dist = argv[i] + 7;
+            if (datagen_dist(dist) < 0) { fprintf(stderr, "unknown distribution: %s (" DATAGEN_NAMES ")\n", dist); return 1; }
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) seed = strtoull(argv[i] + 7, NULL, 10);
+        else if (strncmp(argv[i], "--mem=", 6) == 0) mem_mb = atol(argv[i] + 6);
+        else if (strncmp(argv[i], "--in=", 5) == 0)  ext_in = argv[i] + 5;
+        else if (strncmp(argv[i], "--out=", 6) == 0) ext_out = argv[i] + 6;
+        else if (strncmp(argv[i], "--tmp=", 6) == 0) tmpdir = argv[i] + 6;
+        else if (strncmp(argv[i], "--merge=", 8) == 0) {
+            if (strcmp(argv[i] + 8, "serial") == 0) serial_merge = 1;
+            else if (strcmp(argv[i] + 8, "pway") == 0) serial_merge = 0;
+            else { fprintf(stderr, "unknown merge: %s\n", argv[i] + 8); return 1; }
+        } else if (strncmp(argv[i], "--algo=", 7) == 0) {
+            if (strcmp(argv[i] + 7, "radix") == 0) radix = 1;
+            else if (strcmp(argv[i] + 7, "qsort") == 0) radix = 0;
+            else { fprintf(stderr, "unknown algorithm: %s\n", argv[i] + 7); return 1; }
+        } else if (pos == 0) { N = atol(argv[i]); ++pos; }
+        else if (pos == 1)   { P = atoi(argv[i]); ++pos; }
+    }
+    if (N < 1 || P < 1 || mem_mb < 1 || bad_place) {
+        fprintf(stderr, "usage: %s N P [--algo=qsort|radix] [--merge=pway|serial] [--dist=D] [--seed=S]\n"
+                        "       %s N P --external [--mem=MiB] [--in=FILE] [--out=FILE] [--tmp=DIR]\n"
+                        "       common: [--reps=R] [--warmup=W] [--bench-out=FILE.csv|FILE.json]\n"
+                        "               [--bind=none|compact|scatter|core] [--hugepages=off|thp|explicit]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+    bench_config(&bench, "N", "%ld", N);
+    bench_config(&bench, "P", "%d", P);
+    if (external) {
+        bench.name = "ext_sort";
+        bench_config(&bench, "mem_mb", "%ld", mem_mb);
+        bench_config(&bench, "dist", "%s", ext_in ? ext_in : dist);
+        bench_config(&bench, "seed", "%llu", (unsigned long long)seed);
+        return run_external(&bench, N, P, mem_mb, ext_in, ext_out, tmpdir, dist, seed);
+    }
+    bench_config(&bench, "algo", "%s", radix ? "radix" : serial_merge ? "merge-serial" : "merge-pway");
+    bench_config(&bench, "dist", "%s", dist);
+    bench_config(&bench, "seed", "%llu", (unsigned long long)seed);
+    bench_config(&bench, "bind", "%s", place_policy_names[place.policy]);
+    bench_config(&bench, "hugepages", "%s", place_huge_names[place.huge]);
+    place_print(&place, P);
 
-    int *arr = malloc(N * sizeof(int));
-    if (!arr) { fprintf(stderr, "malloc failed N=%ld\n", N); return 1; }
-    srand((unsigned)time(NULL));
-    for (long i = 0; i < N; ++i) arr[i] = rand();
+    /*
+     * Worker t sorts and merges into roughly elements [N*t/P, N*(t+1)/P),
+     * so the input and the merge buffer are first touched in those slices
+     * by threads placed like the workers. The serial merge's scratch is
+     * the main thread's.
+     */
+    size_t bytes = N * sizeof(int);
+    int *arr = place_alloc(&place, bytes);
+    int *buffer = radix ? NULL : place_alloc(&place, bytes);
+    int *scratch = serial_merge ? place_alloc(&place, bytes) : NULL;
+    if (!arr || (!radix && !buffer) || (serial_merge && !scratch)) {
+        fprintf(stderr, "malloc failed N=%ld\n", N);
+        return 1;
+    }
+    place_touch(&place, arr, bytes, P);
+    place_touch(&place, buffer, bytes, P);
+    datagen_fill_i32((int32_t *)arr, 0, N, N, dist, seed, P);
 
     int *copy = malloc(N * sizeof(int));
     memcpy(copy, arr, N * sizeof(int));
-    struct timespec t0, t1;
-    clock_gettime(CLOCK_MONOTONIC, &t0);
+    double t0 = bench_now();
     qsort(copy, N, sizeof(int), cmp_int);
-    clock_gettime(CLOCK_MONOTONIC, &t1);
-    double t_seq = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+    double t_seq = bench_now() - t0;
     printf("seq_sort N=%ld time=%.6f\n", N, t_seq);
     free(copy);
 
@@ -47,43 +317,89 @@ int main(int argc, char **argv) {
     long base = N / P;
     long rem  = N % P;
 
-    clock_gettime(CLOCK_MONOTONIC, &t0);
-    long offset = 0;
-    for (int i = 0; i < P; ++i) {
-        long len = base + (i < rem ? 1 : 0);
-        args[i].arr   = arr;
-        args[i].start = offset;
-        args[i].end   = offset + len;
-        pthread_create(&threads[i], NULL, thread_sort, &args[i]);
-        offset += len;
-    }
-    for (int i = 0; i < P; ++i) pthread_join(threads[i], NULL);
-
-    int *buffer = malloc(N * sizeof(int));
-    long curr_len = args[0].end - args[0].start;
-    memcpy(buffer, arr, curr_len * sizeof(int));
-    int *src = buffer;
-    int *dst = malloc(N * sizeof(int));
-    for (int i = 1; i < P; ++i) {
-        long len_i = args[i].end - args[i].start;
-        long p = 0, q = args[i].start, r = 0;
-        while (p < curr_len && q < args[i].end) {
-            if (src[p] <= arr[q]) dst[r++] = src[p++];
-            else                  dst[r++] = arr[q++];
+    int *result = arr;
+    if (radix) radix_thread_start = radix_bind;
+    for (int rep = 0; rep < bench_runs(&bench); ++rep) {
+        if (rep > 0) datagen_fill_i32((int32_t *)arr, 0, N, N, dist, seed, P);
+
+        t0 = bench_now();
+        if (radix) {
+            if (radix_sort_i32((int32_t *)arr, N, P) != 0) {
+                fprintf(stderr, "malloc failed N=%ld\n", N);
+                return 1;
+            }
+            result = arr;
+        } else {
+            long offset = 0;
+            for (int i = 0; i < P; ++i) {
+                long len = base + (i < rem ? 1 : 0);
+                args[i].arr   = arr;
+                args[i].start = offset;
+                args[i].end   = offset + len;
+                args[i].id    = i;
+                pthread_create(&threads[i], NULL, thread_sort, &args[i]);
+                offset += len;
+            }
+            for (int i = 0; i < P; ++i) pthread_join(threads[i], NULL);
+
+            if (serial_merge) {
+                PERF_THREAD(0);
+                PERF_BEGIN(R_MERGE);
+                long curr_len = args[0].end - args[0].start;
+                memcpy(buffer, arr, curr_len * sizeof(int));
+                int *src = buffer;
+                int *dst = scratch;
+                for (int i = 1; i < P; ++i) {
+                    long len_i = args[i].end - args[i].start;
+                    long p = 0, q = args[i].start, r = 0;
+                    while (p < curr_len && q < args[i].end) {
+                        if (src[p] <= arr[q]) dst[r++] = src[p++];
+                        else                  dst[r++] = arr[q++];
+                    }
+                    while (p < curr_len)           dst[r++] = src[p++];
+                    while (q < args[i].end)       dst[r++] = arr[q++];
+                    int *tmp = src; src = dst; dst = tmp;
+                    curr_len += len_i;
+                }
+                if (src != buffer) memcpy(buffer, src, curr_len * sizeof(int));
+                PERF_END(R_MERGE);
+            } else {
+                struct merge_args *margs = malloc(P * sizeof(struct merge_args));
+                for (int i = 0; i < P; ++i) {
+                    margs[i].arr     = arr;
+                    margs[i].out     = buffer;
+                    margs[i].runs    = args;
+                    margs[i].P       = P;
+                    margs[i].id      = i;
+                    margs[i].rank_lo = N * i / P;
+                    margs[i].rank_hi = N * (i + 1) / P;
+                    pthread_create(&threads[i], NULL, thread_merge, &margs[i]);
+                }
+                for (int i = 0; i < P; ++i) pthread_join(threads[i], NULL);
+                free(margs);
+            }
+            result = buffer;
+        }
+        bench_record(&bench, rep, bench_now() - t0);
+        /* Worker 0 of the radix sort is this thread; the next fill must not
+           inherit its single CPU. */
+        if (radix) place_unbind(&place);
+
+        for (long i = 1; i < N; ++i) {
+            if (result[i - 1] > result[i]) {
+                fprintf(stderr, "result not sorted at %ld\n", i);
+                return 1;
+            }
         }
-        while (p < curr_len)           dst[r++] = src[p++];
-        while (q < args[i].end)       dst[r++] = arr[q++];
-        int *tmp = src; src = dst; dst = tmp;
-        curr_len += len_i;
-    }
-    if (src != buffer) memcpy(buffer, src, curr_len * sizeof(int));
-    clock_gettime(CLOCK_MONOTONIC, &t1);
-    double t_par = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
-    printf("par_sort   N=%ld P=%d time=%.6f\n", N, P, t_par);
-
-    free(arr);
-    free(buffer);
-    free(dst);
+    }
+    printf("par_sort   N=%ld P=%d time=%.6f algo=%s dist=%s\n", N, P, bench_median(&bench),
+           radix ? "radix" : serial_merge ? "merge-serial" : "merge-pway", dist);
+    bench_finish(&bench);
+    PERF_REPORT(region_names, NREGIONS);
+
+    place_free(&place, arr, bytes);
+    place_free(&place, buffer, bytes);
+    place_free(&place, scratch, bytes);
     free(threads);
     free(args);
     return 0;
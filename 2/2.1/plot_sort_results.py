@@ -3,10 +3,36 @@ import pandas as pd
 import matplotlib.pyplot as plt
 import os  
 
+# Имя режима на графиках по конфигурации из CSV бенчмарка
+SEQ_MODES = {'qsort': 'seq', 'radix': 'seq-radix'}
+PAR_MODES = {'merge-pway': 'par', 'merge-serial': 'par-serial', 'radix': 'par-radix'}
+
+def load_results():
+    """Сводит CSV из common/bench.h в таблицу N,P,dist,mode,time (медиана)."""
+    frames = []
+    if os.path.exists('bench_seq_sort.csv'):
+        d = pd.read_csv('bench_seq_sort.csv')
+        d['P'] = 1
+        d['mode'] = d['algo'].map(SEQ_MODES)
+        frames.append(d)
+    if os.path.exists('bench_par_sort.csv'):
+        d = pd.read_csv('bench_par_sort.csv')
+        d['mode'] = d['algo'].map(PAR_MODES)
+        frames.append(d)
+    if os.path.exists('bench_ext_sort.csv'):
+        d = pd.read_csv('bench_ext_sort.csv')
+        d['mode'] = 'par-ext'
+        frames.append(d)
+    df = pd.concat(frames, ignore_index=True)
+    df['time'] = df['median']
+    df = df.drop_duplicates(['N', 'P', 'dist', 'mode'], keep='last')
+    return df[['N', 'P', 'dist', 'mode', 'time', 'ci_lo', 'ci_hi']]
+
 def main():
     if not os.path.exists('plots'):
         os.makedirs('plots')
-    df = pd.read_csv('sort_results.csv')
+    results = load_results()
+    df = results[results['dist'] == 'uniform']
     seq_df = df[(df['mode']=='seq') & (df['P']==1)].set_index('N')
 
     par_df = df[df['mode']=='par']
@@ -21,7 +47,10 @@ def main():
         plt.figure()
         Ps = [1] + grp['P'].tolist()
         Su = [1.0] + grp['speedup'].tolist()
-        plt.plot(Ps, Su, '-o')
+        # Полосы — 95% доверительный интервал медианы времени
+        lo = [0.0] + (grp['speedup'] - T1 / grp['ci_hi']).tolist()
+        hi = [0.0] + (T1 / grp['ci_lo'] - grp['speedup']).tolist()
+        plt.errorbar(Ps, Su, yerr=[lo, hi], fmt='-o', capsize=3)
         plt.title(f'Speedup (N={N})')
         plt.xlabel('Число потоков P')
         plt.ylabel('Ускорение S(P)')
@@ -41,7 +70,23 @@ def main():
         plt.savefig(f'plots/efficiency_N{N}.png')
         plt.close()
 
-    print('Plots created: speedup_N*.png and efficiency_N*.png')
+    # Время каждого алгоритма на каждом распределении входных данных
+    # (распределения, кроме uniform, измерены только при одном N и P)
+    dists = results[results['dist'] != 'uniform']
+    for (N, P), _ in dists[dists['P'] > 1].groupby(['N', 'P']):
+        group = results[(results['N'] == N) & results['P'].isin([1, P])]
+        table = group.pivot(index='dist', columns='mode', values='time')
+        table = table.reindex([d for d in group['dist'].unique()])
+        ax = table.plot.bar(figsize=(10, 5), logy=True)
+        ax.set_title(f'Time by input distribution (N={N}, P={P})')
+        ax.set_xlabel('Распределение')
+        ax.set_ylabel('Время (медиана), с')
+        ax.grid(True, axis='y')
+        plt.tight_layout()
+        plt.savefig(f'plots/dist_N{N}.png')
+        plt.close()
+
+    print('Plots created: speedup_N*.png, efficiency_N*.png and dist_N*.png')
 
 if __name__ == '__main__':
     main() 
\ No newline at end of file
@@ -0,0 +1,106 @@
+/*
+ * LSD radix sort for 32- and 64-bit keys, optionally carrying a payload.
+ *
+ *   radix_sort_{u32,i32,f32}(keys, n, nthreads)
+ *   radix_sort_{u64,i64,f64}(keys, n, nthreads)
+ *   radix_sort_kv_{u32,i32,f32}(keys, uint32_t *vals, n, nthreads)
+ *   radix_sort_kv_{u64,i64,f64}(keys, uint64_t *vals, n, nthreads)
+ *
+ * 8-bit digits, one pass per byte; a pass whose digit is the same for all
+ * keys is skipped. Signed and floating-point keys are mapped to unsigned
+ * ones with the same order before the first pass and mapped back after
+ * the last (floats: negative values have all bits flipped, others only
+ * the sign bit; -0.0 sorts before +0.0, NaNs go to the ends).
+ *
+ * Each of nthreads threads owns a fixed slice of the array. Per pass:
+ * every thread counts the digits of its slice (with AVX2 where the CPU
+ * has it: digits of 8 or 4 keys are extracted at once and counted into
+ * four interleaved tables, so runs of equal digits do not serialize on
+ * one counter; -DRADIX_NO_SIMD forces the scalar loop), then computes its own
+ * output offsets from all the per-thread counts, and scatters through
+ * per-bucket buffers of one cache line so that stores to the output go
+ * in full lines rather than one key at a time. The sort is stable.
+ *
+ * Needs a temporary copy of the keys (and of the payload); returns 0 on
+ * success and -1 if the memory cannot be allocated.
+ */
+
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(RADIX_NO_SIMD)
+#define RADIX_X86 1
+#include <immintrin.h>
+#else
+#define RADIX_X86 0
+#endif
+
+#define RADIX_BUCKETS  256
+#define RADIX_WC_BYTES 64
+
+enum { RADIX_UNSIGNED, RADIX_SIGNED, RADIX_FLOAT };
+
+/*
+ * If set, each worker calls it with its thread index before the first
+ * pass (worker 0 is the calling thread), e.g. to bind itself to a CPU.
+ */
+static void (*radix_thread_start)(int tid);
+
+/* Float and double arrays are accessed through these. */
+typedef uint32_t radix_ua32 __attribute__((__may_alias__));
+typedef uint64_t radix_ua64 __attribute__((__may_alias__));
+
+/* pthread_barrier_t is missing on macOS. */
+typedef struct {
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;
+    int n, waiting;
+    unsigned phase;
+} radix_barrier_t;
+
+static inline void radix_barrier_wait(radix_barrier_t *b) {
+    if (b->n == 1) return;
+    pthread_mutex_lock(&b->mu);
+    unsigned phase = b->phase;
+    if (++b->waiting == b->n) {
+        b->waiting = 0;
+        b->phase++;
+        pthread_cond_broadcast(&b->cv);
+    } else {
+        while (phase == b->phase) pthread_cond_wait(&b->cv, &b->mu);
+    }
+    pthread_mutex_unlock(&b->mu);
+}
+
+#define RADIX_SFX     32
+#define RADIX_UK      radix_ua32
+#define RADIX_VT      uint32_t
+#define RADIX_KEYBITS 32
+#include "radix_sort_impl.h"
+
+#define RADIX_SFX     64
+#define RADIX_UK      radix_ua64
+#define RADIX_VT      uint64_t
+#define RADIX_KEYBITS 64
+#include "radix_sort_impl.h"
+
+static inline int radix_sort_u32(uint32_t *k, size_t n, int t) { return radix_sort_run_32((radix_ua32 *)k, NULL, n, RADIX_UNSIGNED, t); }
+static inline int radix_sort_i32(int32_t  *k, size_t n, int t) { return radix_sort_run_32((radix_ua32 *)k, NULL, n, RADIX_SIGNED,   t); }
+static inline int radix_sort_f32(float    *k, size_t n, int t) { return radix_sort_run_32((radix_ua32 *)k, NULL, n, RADIX_FLOAT,    t); }
+static inline int radix_sort_u64(uint64_t *k, size_t n, int t) { return radix_sort_run_64((radix_ua64 *)k, NULL, n, RADIX_UNSIGNED, t); }
+static inline int radix_sort_i64(int64_t  *k, size_t n, int t) { return radix_sort_run_64((radix_ua64 *)k, NULL, n, RADIX_SIGNED,   t); }
+static inline int radix_sort_f64(double   *k, size_t n, int t) { return radix_sort_run_64((radix_ua64 *)k, NULL, n, RADIX_FLOAT,    t); }
+
+static inline int radix_sort_kv_u32(uint32_t *k, uint32_t *v, size_t n, int t) { return radix_sort_run_32((radix_ua32 *)k, v, n, RADIX_UNSIGNED, t); }
+static inline int radix_sort_kv_i32(int32_t  *k, uint32_t *v, size_t n, int t) { return radix_sort_run_32((radix_ua32 *)k, v, n, RADIX_SIGNED,   t); }
+static inline int radix_sort_kv_f32(float    *k, uint32_t *v, size_t n, int t) { return radix_sort_run_32((radix_ua32 *)k, v, n, RADIX_FLOAT,    t); }
+static inline int radix_sort_kv_u64(uint64_t *k, uint64_t *v, size_t n, int t) { return radix_sort_run_64((radix_ua64 *)k, v, n, RADIX_UNSIGNED, t); }
+static inline int radix_sort_kv_i64(int64_t  *k, uint64_t *v, size_t n, int t) { return radix_sort_run_64((radix_ua64 *)k, v, n, RADIX_SIGNED,   t); }
+static inline int radix_sort_kv_f64(double   *k, uint64_t *v, size_t n, int t) { return radix_sort_run_64((radix_ua64 *)k, v, n, RADIX_FLOAT,    t); }
+
+#endif /* RADIX_SORT_H */
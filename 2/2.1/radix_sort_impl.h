@@ -0,0 +1,208 @@
+/*
+ * Body of radix_sort.h for one key width; included once per width with
+ * RADIX_SFX, RADIX_UK (unsigned key), RADIX_VT (payload) and
+ * RADIX_KEYBITS defined. Not meant to be included directly.
+ */
+
+#define RADIX_CAT_(a, b) a##b
+#define RADIX_CAT(a, b)  RADIX_CAT_(a, b)
+#define RADIX_FN(name)   RADIX_CAT(name, RADIX_SFX)
+#define RADIX_WC         (RADIX_WC_BYTES / (int)sizeof(RADIX_UK))
+#define RADIX_TOP        ((RADIX_UK)1 << (RADIX_KEYBITS - 1))
+
+typedef struct {
+    RADIX_UK *keys, *ktmp;
+    RADIX_VT *vals, *vtmp;
+    size_t n;
+    int nthreads, mode;
+    size_t (*count)[RADIX_BUCKETS];
+    void (*hist)(const RADIX_UK *, size_t, size_t, int, size_t *);
+    radix_barrier_t bar;
+} RADIX_FN(radix_shared_);
+
+typedef struct {
+    RADIX_FN(radix_shared_) *sh;
+    int tid;
+} RADIX_FN(radix_arg_);
+
+static inline void RADIX_FN(radix_encode_)(RADIX_UK *k, size_t lo, size_t hi, int mode) {
+    if (mode == RADIX_SIGNED) {
+        for (size_t i = lo; i < hi; ++i) k[i] ^= RADIX_TOP;
+    } else if (mode == RADIX_FLOAT) {
+        for (size_t i = lo; i < hi; ++i)
+            k[i] ^= ((RADIX_UK)0 - (k[i] >> (RADIX_KEYBITS - 1))) | RADIX_TOP;
+    }
+}
+
+static inline void RADIX_FN(radix_decode_)(RADIX_UK *k, size_t lo, size_t hi, int mode) {
+    if (mode == RADIX_SIGNED) {
+        for (size_t i = lo; i < hi; ++i) k[i] ^= RADIX_TOP;
+    } else if (mode == RADIX_FLOAT) {
+        for (size_t i = lo; i < hi; ++i)
+            k[i] ^= ((k[i] >> (RADIX_KEYBITS - 1)) - 1) | RADIX_TOP;
+    }
+}
+
+/* Adds the counts of digit (k >> shift) & 0xFF over src[lo, hi) to cnt. */
+static void RADIX_FN(radix_hist_scalar_)(const RADIX_UK *src, size_t lo, size_t hi,
+                                         int shift, size_t *cnt) {
+    for (size_t i = lo; i < hi; ++i) cnt[(src[i] >> shift) & 0xFF]++;
+}
+
+#if RADIX_X86
+__attribute__((target("avx2")))
+static void RADIX_FN(radix_hist_avx2_)(const RADIX_UK *src, size_t lo, size_t hi,
+                                       int shift, size_t *cnt) {
+    size_t c[4][RADIX_BUCKETS];
+    memset(c, 0, sizeof(c));
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    size_t i = lo;
+#if RADIX_KEYBITS == 32
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    uint32_t d[8] __attribute__((aligned(32)));
+    for (; i + 8 <= hi; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_store_si256((__m256i *)d, _mm256_and_si256(_mm256_srl_epi32(v, sh), mask));
+        c[0][d[0]]++; c[1][d[1]]++; c[2][d[2]]++; c[3][d[3]]++;
+        c[0][d[4]]++; c[1][d[5]]++; c[2][d[6]]++; c[3][d[7]]++;
+    }
+#else
+    const __m256i mask = _mm256_set1_epi64x(0xFF);
+    uint64_t d[4] __attribute__((aligned(32)));
+    for (; i + 4 <= hi; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_store_si256((__m256i *)d, _mm256_and_si256(_mm256_srl_epi64(v, sh), mask));
+        c[0][d[0]]++; c[1][d[1]]++; c[2][d[2]]++; c[3][d[3]]++;
+    }
+#endif
+    for (; i < hi; ++i) c[0][(src[i] >> shift) & 0xFF]++;
+    for (int b = 0; b < RADIX_BUCKETS; ++b) cnt[b] += c[0][b] + c[1][b] + c[2][b] + c[3][b];
+}
+#endif
+
+static void *RADIX_FN(radix_worker_)(void *p) {
+    RADIX_FN(radix_arg_) *arg = p;
+    RADIX_FN(radix_shared_) *sh = arg->sh;
+    int T = sh->nthreads, tid = arg->tid;
+    size_t n = sh->n;
+    size_t lo = n * tid / T, hi = n * (tid + 1) / T;
+    RADIX_UK *src = sh->keys, *dst = sh->ktmp;
+    RADIX_VT *vsrc = sh->vals, *vdst = sh->vtmp;
+    size_t *cnt = sh->count[tid];
+    size_t pos[RADIX_BUCKETS];
+    unsigned char fill[RADIX_BUCKETS];
+    RADIX_UK kbuf[RADIX_BUCKETS][RADIX_WC] __attribute__((aligned(64)));
+    RADIX_VT vbuf[RADIX_BUCKETS][RADIX_WC] __attribute__((aligned(64)));
+
+    if (radix_thread_start) radix_thread_start(tid);
+    RADIX_FN(radix_encode_)(src, lo, hi, sh->mode);
+
+    for (int shift = 0; shift < RADIX_KEYBITS; shift += 8) {
+        memset(cnt, 0, RADIX_BUCKETS * sizeof(size_t));
+        sh->hist(src, lo, hi, shift, cnt);
+        radix_barrier_wait(&sh->bar);
+
+        size_t base = 0;
+        int skip = 0;
+        for (int d = 0; d < RADIX_BUCKETS; ++d) {
+            size_t before = 0, total = 0;
+            for (int t = 0; t < T; ++t) {
+                if (t == tid) before = total;
+                total += sh->count[t][d];
+            }
+            if (total == n) skip = 1;
+            pos[d] = base + before;
+            base += total;
+        }
+        if (!skip) {
+            memset(fill, 0, sizeof(fill));
+            for (size_t i = lo; i < hi; ++i) {
+                RADIX_UK k = src[i];
+                unsigned d = (unsigned)(k >> shift) & 0xFF;
+                unsigned f = fill[d];
+                kbuf[d][f] = k;
+                if (vsrc) vbuf[d][f] = vsrc[i];
+                if (++f == RADIX_WC) {
+                    memcpy(dst + pos[d], kbuf[d], sizeof(kbuf[d]));
+                    if (vsrc) memcpy(vdst + pos[d], vbuf[d], sizeof(vbuf[d]));
+                    pos[d] += RADIX_WC;
+                    f = 0;
+                }
+                fill[d] = (unsigned char)f;
+            }
+            for (int d = 0; d < RADIX_BUCKETS; ++d) {
+                memcpy(dst + pos[d], kbuf[d], fill[d] * sizeof(RADIX_UK));
+                if (vsrc) memcpy(vdst + pos[d], vbuf[d], fill[d] * sizeof(RADIX_VT));
+            }
+        }
+        /* Nobody may overwrite its counts or read dst before all are done. */
+        radix_barrier_wait(&sh->bar);
+        if (!skip) {
+            RADIX_UK *kt = src; src = dst; dst = kt;
+            RADIX_VT *vt = vsrc; vsrc = vdst; vdst = vt;
+        }
+    }
+
+    if (src != sh->keys) {
+        memcpy(sh->keys + lo, src + lo, (hi - lo) * sizeof(RADIX_UK));
+        if (vsrc) memcpy(sh->vals + lo, vsrc + lo, (hi - lo) * sizeof(RADIX_VT));
+    }
+    RADIX_FN(radix_decode_)(sh->keys, lo, hi, sh->mode);
+    return NULL;
+}
+
+static inline int RADIX_FN(radix_sort_run_)(RADIX_UK *keys, RADIX_VT *vals, size_t n,
+                                            int mode, int nthreads) {
+    if (n < 2) return 0;
+    if (nthreads < 1) nthreads = 1;
+    if ((size_t)nthreads > n) nthreads = (int)n;
+
+    RADIX_FN(radix_shared_) sh;
+    sh.keys = keys;
+    sh.vals = vals;
+    sh.n = n;
+    sh.nthreads = nthreads;
+    sh.mode = mode;
+    sh.hist = RADIX_FN(radix_hist_scalar_);
+#if RADIX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) sh.hist = RADIX_FN(radix_hist_avx2_);
+#endif
+    sh.ktmp = malloc(n * sizeof(RADIX_UK));
+    sh.vtmp = vals ? malloc(n * sizeof(RADIX_VT)) : NULL;
+    sh.count = malloc(nthreads * sizeof(*sh.count));
+    pthread_t *th = malloc(nthreads * sizeof(pthread_t));
+    RADIX_FN(radix_arg_) *args = malloc(nthreads * sizeof(*args));
+    if (!sh.ktmp || (vals && !sh.vtmp) || !sh.count || !th || !args) {
+        free(sh.ktmp); free(sh.vtmp); free(sh.count); free(th); free(args);
+        return -1;
+    }
+    pthread_mutex_init(&sh.bar.mu, NULL);
+    pthread_cond_init(&sh.bar.cv, NULL);
+    sh.bar.n = nthreads;
+    sh.bar.waiting = 0;
+    sh.bar.phase = 0;
+
+    for (int t = 0; t < nthreads; ++t) {
+        args[t].sh = &sh;
+        args[t].tid = t;
+        if (t > 0) pthread_create(&th[t], NULL, RADIX_FN(radix_worker_), &args[t]);
+    }
+    RADIX_FN(radix_worker_)(&args[0]);
+    for (int t = 1; t < nthreads; ++t) pthread_join(th[t], NULL);
+
+    pthread_mutex_destroy(&sh.bar.mu);
+    pthread_cond_destroy(&sh.bar.cv);
+    free(sh.ktmp); free(sh.vtmp); free(sh.count); free(th); free(args);
+    return 0;
+}
+
+#undef RADIX_TOP
+#undef RADIX_WC
+#undef RADIX_FN
+#undef RADIX_CAT
+#undef RADIX_CAT_
+#undef RADIX_SFX
+#undef RADIX_UK
+#undef RADIX_VT
+#undef RADIX_KEYBITS
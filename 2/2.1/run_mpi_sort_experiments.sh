@@ -0,0 +1,26 @@
+#!/bin/bash
+set -e
+
+# Компиляция
+echo "Компиляция mpi_sort..."
+mpicc -O2 -o mpi_sort mpi_sort.c -lm
+
+# Слабая масштабируемость: N ключей на каждый процесс.
+# mpi_sort сам пишет конфигурацию, медиану по REPS повторам и времена фаз
+# в bench_mpi_sort.csv (common/bench.h); P — столбец ranks.
+
+N=${N:-1000000}
+REPS=${REPS:-5}
+WARMUP=${WARMUP:-1}
+Ps=(1 2 4 8 16)
+Ds=(uniform nearly reverse few equal zipf)
+
+rm -f bench_mpi_sort.csv
+
+for D in "${Ds[@]}"; do
+    for P in "${Ps[@]}"; do
+        echo "MPI sort: N=$N per rank, P=$P, dist=$D"
+        mpirun --oversubscribe -np $P ./mpi_sort $N --dist=$D \
+            --reps=$REPS --warmup=$WARMUP --bench-out=bench_mpi_sort.csv
+    done
+done
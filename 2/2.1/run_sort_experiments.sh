@@ -3,32 +3,67 @@ set -e
 
 # Компиляция выполняемых файлов
 echo "Компиляция seq_sort и parallel_sort..."
-gcc -O2 -o seq_sort seq_sort.c
-gcc -O2 -pthread -o parallel_sort parallel_sort.c
+gcc -O2 -pthread -o seq_sort seq_sort.c -lm
+gcc -O2 -pthread -o parallel_sort parallel_sort.c -lm
 
-# Скрипт для измерения времени работы seq_sort и par_sort
-# Формат выходного CSV: N,P,mode,time
+# Проверка всех вариантов radix_sort (ключи и ключ+значение) против qsort
+# до замеров: на равномерных данных и на данных с повторами (устойчивость)
+for D in uniform few; do
+  ./seq_sort 100000 --check --dist=$D > /dev/null || { echo "radix_sort --check ($D) не прошёл"; exit 1; }
+done
+
+# Скрипт для измерения времени работы seq_sort и par_sort.
+# Каждая точка — REPS повторов после WARMUP прогревочных; программы сами
+# пишут конфигурацию, медиану, IQR и доверительный интервал в CSV
+# (common/bench.h):
+#   bench_seq_sort.csv  — seq_sort (algo = qsort | radix)
+#   bench_par_sort.csv  — parallel_sort (algo = merge-pway | merge-serial | radix)
+#   bench_ext_sort.csv  — parallel_sort --external
+REPS=${REPS:-5}
+WARMUP=${WARMUP:-1}
+BENCH="--reps=$REPS --warmup=$WARMUP"
+# Размещение потоков parallel_sort (common/placement.h): по умолчанию
+# один поток на физическое ядро, чтобы кривые ускорения воспроизводились.
+BIND=${BIND:-core}
+HUGEPAGES=${HUGEPAGES:-off}
+PLACE="--bind=$BIND --hugepages=$HUGEPAGES"
+rm -f bench_seq_sort.csv bench_par_sort.csv bench_ext_sort.csv
 
 # Размеры массива
 Ns=(100000 200000 500000 1000000)
 # Число потоков для par_sort
 Ts=(2 4 8 16)
 
-# Заголовок
-echo "N,P,mode,time" > sort_results.csv
-
 # Последовательная сортировка
 for N in "${Ns[@]}"; do
     echo "Seq sort: N=$N"
-    t=$(./seq_sort $N | awk '{print $3}' | cut -d'=' -f2 | tr -d '\r\n')
-    printf "%d,1,seq,%s\n" "$N" "$t" >> sort_results.csv
+    ./seq_sort $N $BENCH --bench-out=bench_seq_sort.csv
+    ./seq_sort $N --algo=radix $BENCH --bench-out=bench_seq_sort.csv
 done
 
 # Параллельная сортировка
 for N in "${Ns[@]}"; do
     for P in "${Ts[@]}"; do
         echo "Par sort: N=$N, threads=$P"
-        t=$(./parallel_sort $N $P | awk '{print $4}' | cut -d'=' -f2 | tr -d '\r\n')
-        printf "%d,%d,par,%s\n" "$N" "$P" "$t" >> sort_results.csv
+        ./parallel_sort $N $P $PLACE $BENCH --bench-out=bench_par_sort.csv
+        # Старый последовательный этап слияния — для сравнения
+        ./parallel_sort $N $P --merge=serial $PLACE $BENCH --bench-out=bench_par_sort.csv
+        ./parallel_sort $N $P --algo=radix $PLACE $BENCH --bench-out=bench_par_sort.csv
+        # Внешняя сортировка через файл, буферы не больше 1 МиБ
+        ./parallel_sort $N $P --external --mem=1 $BENCH --bench-out=bench_ext_sort.csv
     done
-done 
\ No newline at end of file
+done
+
+# Сравнение алгоритмов на разных распределениях входных данных
+DN=1000000
+DP=4
+Dists=(sorted reverse nearly few equal zipf)
+for D in "${Dists[@]}"; do
+    echo "Distribution: $D"
+    ./seq_sort $DN --dist=$D $BENCH --bench-out=bench_seq_sort.csv
+    ./seq_sort $DN --dist=$D --algo=radix $BENCH --bench-out=bench_seq_sort.csv
+    ./parallel_sort $DN $DP --dist=$D $PLACE $BENCH --bench-out=bench_par_sort.csv
+    ./parallel_sort $DN $DP --dist=$D --merge=serial $PLACE $BENCH --bench-out=bench_par_sort.csv
+    ./parallel_sort $DN $DP --dist=$D --algo=radix $PLACE $BENCH --bench-out=bench_par_sort.csv
+    ./parallel_sort $DN $DP --dist=$D --external --mem=1 $BENCH --bench-out=bench_ext_sort.csv
+done
@@ -1,6 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "radix_sort.h"
+#include "datagen.h"
+#include "../../common/bench.h"
 
 int cmp_int(const void *a, const void *b) {
     int ai = *(const int*)a;
@@ -8,9 +13,109 @@ int cmp_int(const void *a, const void *b) {
     return (ai > bi) - (ai < bi);
 }
 
+/*
+ * --check: every radix_sort entry point (keys only and key+payload, one
+ * and four threads) against qsort on the same data. Keys of each type are
+ * derived from the generated int32 keys, so --dist=few or equal exercises
+ * stability; float keys also get signed zeros and infinities. The payload
+ * is the original index, and the reference sorts (key, index) pairs, so it
+ * must come out exactly as the stable radix order.
+ */
+#define RADIX_CHECK(SFX, KT, VT, KEY)                                            \
+static int radix_key_cmp_##SFX(KT a, KT b) {                                     \
+    int c = (a > b) - (a < b);                                                   \
+    return c ? c : (signbit((double)b) != 0) - (signbit((double)a) != 0);        \
+}                                                                                \
+static int radix_cmp_##SFX(const void *a, const void *b) {                       \
+    return radix_key_cmp_##SFX(*(const KT *)a, *(const KT *)b);                  \
+}                                                                                \
+typedef struct { KT k; VT v; } radix_pair_##SFX;                                 \
+static int radix_pair_cmp_##SFX(const void *a, const void *b) {                  \
+    const radix_pair_##SFX *p = a, *q = b;                                       \
+    int c = radix_key_cmp_##SFX(p->k, q->k);                                     \
+    return c ? c : (p->v > q->v) - (p->v < q->v);                                \
+}                                                                                \
+static int radix_check_##SFX(const int32_t *x, long n, int nthreads, int kv) {   \
+    KT *k = malloc(n * sizeof(KT));                                              \
+    VT *v = malloc(n * sizeof(VT));                                              \
+    radix_pair_##SFX *ref = malloc(n * sizeof(*ref));                            \
+    if (!k || !v || !ref) { free(k); free(v); free(ref); return -1; }            \
+    for (long i = 0; i < n; ++i) {                                               \
+        k[i] = KEY;                                                              \
+        v[i] = (VT)i;                                                            \
+        ref[i].k = k[i];                                                         \
+        ref[i].v = (VT)i;                                                        \
+    }                                                                            \
+    int rc = kv ? radix_sort_kv_##SFX(k, v, n, nthreads)                         \
+                : radix_sort_##SFX(k, n, nthreads);                              \
+    if (kv) qsort(ref, n, sizeof(*ref), radix_pair_cmp_##SFX);                   \
+    else    qsort(ref, n, sizeof(*ref), radix_cmp_##SFX);                        \
+    for (long i = 0; i < n && rc == 0; ++i)                                      \
+        if (memcmp(&k[i], &ref[i].k, sizeof(KT)) != 0 || (kv && v[i] != ref[i].v)) \
+            rc = 1;                                                              \
+    free(k); free(v); free(ref);                                                 \
+    return rc;                                                                   \
+}
+
+#define CHECK_SPREAD ((int64_t)x[i] - 0x3FFFFFFF)
+#define CHECK_ZERO   (i % 101 == 0)
+RADIX_CHECK(u32, uint32_t, uint32_t, (uint32_t)x[i] * 2654435761u)
+RADIX_CHECK(i32, int32_t,  uint32_t, (int32_t)CHECK_SPREAD)
+RADIX_CHECK(f32, float,    uint32_t, CHECK_ZERO ? (i & 2 ? -0.0f : 0.0f)
+                                     : i % 997 == 0 ? (i & 1 ? INFINITY : -INFINITY)
+                                     : (float)CHECK_SPREAD / 1024.0f)
+RADIX_CHECK(u64, uint64_t, uint64_t, (uint64_t)x[i] * 0x9E3779B97F4A7C15ull)
+RADIX_CHECK(i64, int64_t,  uint64_t, CHECK_SPREAD * 4294967311ll)
+RADIX_CHECK(f64, double,   uint64_t, CHECK_ZERO ? (i & 2 ? -0.0 : 0.0)
+                                     : i % 997 == 0 ? (i & 1 ? INFINITY : -INFINITY)
+                                     : (double)CHECK_SPREAD * 1e-3)
+
+static int radix_check(long n, const char *dist, uint64_t seed) {
+    static const char *names[] = {"u32", "i32", "f32", "u64", "i64", "f64"};
+    static int (*const fns[])(const int32_t *, long, int, int) = {
+        radix_check_u32, radix_check_i32, radix_check_f32,
+        radix_check_u64, radix_check_i64, radix_check_f64};
+    int32_t *x = malloc(n * sizeof(int32_t));
+    if (!x) return -1;
+    datagen_fill_i32(x, 0, n, n, dist, seed, 1);
+    int failed = 0;
+    for (int f = 0; f < 6; ++f)
+        for (int kv = 0; kv < 2; ++kv)
+            for (int t = 1; t <= 4; t += 3) {
+                int rc = fns[f](x, n, t, kv);
+                printf("check radix_sort%s_%s N=%ld threads=%d dist=%s: %s\n", kv ? "_kv" : "",
+                       names[f], n, t, dist, rc == 0 ? "ok" : rc < 0 ? "no memory" : "FAILED");
+                failed |= rc != 0;
+            }
+    free(x);
+    return failed;
+}
+
 int main(int argc, char **argv) {
+    bench_t bench;
+    bench_init(&bench, "seq_sort", &argc, argv);
     long N = 1000000;
-    if (argc >= 2) N = atol(argv[1]);
+    int radix = 0, check = 0;
+    const char *dist = "uniform";
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--dist=", 7) == 0) {
+            dist = argv[i] + 7;
+            if (datagen_dist(dist) < 0) { fprintf(stderr, "Unknown distribution: %s (" DATAGEN_NAMES ")\n", dist); return EXIT_FAILURE; }
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoull(argv[i] + 7, NULL, 10);
+        } else if (strncmp(argv[i], "--algo=", 7) == 0) {
+            if (strcmp(argv[i] + 7, "radix") == 0) radix = 1;
+            else if (strcmp(argv[i] + 7, "qsort") == 0) radix = 0;
+            else { fprintf(stderr, "Unknown algorithm: %s\n", argv[i] + 7); return EXIT_FAILURE; }
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = 1;
+        } else {
+            N = atol(argv[i]);
+        }
+    }
+
+    if (check) return radix_check(N, dist, seed) ? EXIT_FAILURE : EXIT_SUCCESS;
 
     int *arr = malloc(N * sizeof(int));
     if (!arr) {
@@ -18,18 +123,27 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    srand((unsigned)time(NULL));
-    for (long i = 0; i < N; ++i) {
-        arr[i] = rand();
-    }
+    bench_config(&bench, "N", "%ld", N);
+    bench_config(&bench, "algo", "%s", radix ? "radix" : "qsort");
+    bench_config(&bench, "dist", "%s", dist);
+    bench_config(&bench, "seed", "%llu", (unsigned long long)seed);
+    for (int r = 0; r < bench_runs(&bench); ++r) {
+        datagen_fill_i32((int32_t *)arr, 0, N, N, dist, seed, 1);
 
-    struct timespec t0, t1;
-    clock_gettime(CLOCK_MONOTONIC, &t0);
-    qsort(arr, N, sizeof(int), cmp_int);
-    clock_gettime(CLOCK_MONOTONIC, &t1);
+        double t0 = bench_now();
+        if (radix) {
+            if (radix_sort_i32((int32_t *)arr, N, 1) != 0) {
+                fprintf(stderr, "Memory allocation error. N=%ld\n", N);
+                return EXIT_FAILURE;
+            }
+        } else {
+            qsort(arr, N, sizeof(int), cmp_int);
+        }
+        bench_record(&bench, r, bench_now() - t0);
+    }
 
-    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
-    printf("seq_sort N=%ld time=%.6f\n", N, elapsed);
+    printf("seq_sort N=%ld time=%.6f algo=%s dist=%s\n", N, bench_median(&bench), radix ? "radix" : "qsort", dist);
+    bench_finish(&bench);
 
     free(arr);
     return 0;
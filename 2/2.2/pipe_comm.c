@@ -1,12 +1,28 @@
+/*
+ * Round-trip latency of a one-byte message between a parent and a child
+ * process over a pair of pipes.
+ *
+ * Compilation:
+ *    gcc -O2 -o pipe_comm pipe_comm.c -lm
+ *
+ * Usage:
+ *    ./pipe_comm [iterations] [--reps=R] [--warmup=W] [--bench-out=FILE]
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <sys/time.h>
 #include <sys/wait.h>
+#include "../../common/bench.h"
 
 int main(int argc, char *argv[]) {
+    bench_t bench;
+    bench_init(&bench, "pipe_comm", &argc, argv);
     int iterations = 1000000;
     if (argc >= 2) iterations = atoi(argv[1]);
+    bench_config(&bench, "iterations", "%d", iterations);
+    // Child answers every round trip of every run, warm-up included
+    long total_iterations = (long)iterations * bench_runs(&bench);
 
     int p1[2], p2[2];
     if (pipe(p1) < 0 || pipe(p2) < 0) {
@@ -25,19 +41,20 @@ int main(int argc, char *argv[]) {
         close(p1[0]);  // close read end of p1
         close(p2[1]);  // close write end of p2
         char buf = 0;
-        struct timeval t0, t1;
-        double total = 0.0;
-
-        for (int i = 0; i < iterations; ++i) {
-            gettimeofday(&t0, NULL);
-            write(p1[1], &buf, 1);
-            read(p2[0], &buf, 1);
-            gettimeofday(&t1, NULL);
-            total += (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) * 1e-6;
+
+        // One sample per run: mean round trip over `iterations` exchanges
+        for (int r = 0; r < bench_runs(&bench); ++r) {
+            double t0 = bench_now();
+            for (int i = 0; i < iterations; ++i) {
+                write(p1[1], &buf, 1);
+                read(p2[0], &buf, 1);
+            }
+            bench_record(&bench, r, (bench_now() - t0) / iterations);
         }
 
-        double avg = total / iterations;
+        double avg = bench_median(&bench);
         printf("pipe_comm iterations=%d avg_time=%.9f sec\n", iterations, avg);
+        bench_finish(&bench);
 
         wait(NULL);
         close(p1[1]);
@@ -47,7 +64,7 @@ int main(int argc, char *argv[]) {
         close(p1[1]);  // close write end of p1
         close(p2[0]);  // close read end of p2
         char buf;
-        for (int i = 0; i < iterations; ++i) {
+        for (long i = 0; i < total_iterations; ++i) {
             read(p1[0], &buf, 1);
             write(p2[1], &buf, 1);
         }
@@ -0,0 +1,334 @@
+/*
+ * Ping-pong and streaming between two processes over single-producer /
+ * single-consumer rings in MAP_SHARED anonymous memory (one ring per
+ * direction).
+ *
+ * Compilation:
+ *    gcc -O2 -o ring_comm ring_comm.c -lm
+ *
+ * Usage:
+ *    ./ring_comm [iterations] [--policy=busy|spin|futex] [--msg=BYTES]
+ *                [--stream-msg=BYTES] [--stream-total=BYTES] [--batch=N]
+ *                [--ring=BYTES] [--reps=R] [--warmup=W] [--bench-out=FILE]
+ *
+ * The ring is a byte stream of length-prefixed messages; a message larger
+ * than the ring is passed through in pieces. The producer index (head)
+ * and the consumer index (tail) are free-running 32-bit counters, each on
+ * its own cache line, and each side keeps a private copy of the other's
+ * index so that it only touches the remote line when the ring looks
+ * full/empty. The producer publishes head once per batch of messages.
+ *
+ * Wait policies: busy polls the index; spin polls for a while and then
+ * sleeps on the index with futex; futex sleeps straight away. A sleeper
+ * raises a flag before its final check and the other side wakes it only
+ * when the flag is up, so the fast path has no system calls. Without
+ * futex (non-Linux) sleeping falls back to sched_yield.
+ *
+ * Each repetition runs both the ping-pong and the stream; the printed
+ * times are medians (bench.h), and the stream time and bandwidth are
+ * recorded as metrics of the ping-pong benchmark.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "../../common/bench.h"
+
+#define SPIN_LIMIT 4000
+
+enum { WAIT_BUSY, WAIT_SPIN, WAIT_FUTEX };
+static const char *policy_names[] = {"busy", "spin", "futex"};
+
+typedef struct {
+    _Alignas(64) atomic_uint head;      /* written by the producer */
+    atomic_uint prod_waiting;
+    _Alignas(64) atomic_uint tail;      /* written by the consumer */
+    atomic_uint cons_waiting;
+    _Alignas(64) unsigned char data[];
+} ring_ctrl_t;
+
+/* One side of a ring, private to the process using it. */
+typedef struct {
+    ring_ctrl_t *c;
+    uint32_t cap, mask;
+    uint32_t pos;        /* own index */
+    uint32_t published;  /* last value of pos made visible */
+    uint32_t cached;     /* last seen value of the other side's index */
+    int policy;
+} ring_end_t;
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void futex_wait(atomic_uint *addr, uint32_t val) {
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, val, NULL, NULL, 0);
+#else
+    (void)addr; (void)val;
+    sched_yield();
+#endif
+}
+
+static void futex_wake(atomic_uint *addr) {
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+    (void)addr;
+#endif
+}
+
+/* Waits until *word differs from seen. */
+static void ring_wait(atomic_uint *word, uint32_t seen, atomic_uint *flag, int policy) {
+    if (policy == WAIT_BUSY) {
+        while (atomic_load_explicit(word, memory_order_acquire) == seen) cpu_relax();
+        return;
+    }
+    if (policy == WAIT_SPIN) {
+        for (int i = 0; i < SPIN_LIMIT; ++i) {
+            if (atomic_load_explicit(word, memory_order_acquire) != seen) return;
+            cpu_relax();
+        }
+    }
+    for (;;) {
+        atomic_store(flag, 1);
+        if (atomic_load(word) != seen) break;
+        futex_wait(word, seen);
+    }
+    atomic_store_explicit(flag, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+}
+
+/* Makes a new value of *word visible and wakes the other side if it sleeps. */
+static void ring_signal(atomic_uint *word, uint32_t val, atomic_uint *flag, int policy) {
+    atomic_store_explicit(word, val, memory_order_release);
+    if (policy == WAIT_BUSY) return;
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(flag, memory_order_relaxed)) futex_wake(word);
+}
+
+static void ring_publish(ring_end_t *r) {
+    if (r->pos == r->published) return;
+    r->published = r->pos;
+    ring_signal(&r->c->head, r->pos, &r->c->cons_waiting, r->policy);
+}
+
+static void ring_release(ring_end_t *r) {
+    if (r->pos == r->published) return;
+    r->published = r->pos;
+    ring_signal(&r->c->tail, r->pos, &r->c->prod_waiting, r->policy);
+}
+
+static void ring_put(ring_end_t *r, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    while (len > 0) {
+        uint32_t space = r->cap - (r->pos - r->cached);
+        if (space == 0) {
+            r->cached = atomic_load_explicit(&r->c->tail, memory_order_acquire);
+            space = r->cap - (r->pos - r->cached);
+            if (space == 0) {
+                ring_publish(r);
+                ring_wait(&r->c->tail, r->cached, &r->c->prod_waiting, r->policy);
+                continue;
+            }
+        }
+        uint32_t n = len < space ? (uint32_t)len : space;
+        uint32_t off = r->pos & r->mask;
+        uint32_t first = n < r->cap - off ? n : r->cap - off;
+        memcpy(r->c->data + off, p, first);
+        memcpy(r->c->data, p + first, n - first);
+        r->pos += n;
+        p += n;
+        len -= n;
+    }
+}
+
+static void ring_get(ring_end_t *r, void *buf, size_t len) {
+    unsigned char *p = buf;
+    while (len > 0) {
+        uint32_t avail = r->cached - r->pos;
+        if (avail == 0) {
+            r->cached = atomic_load_explicit(&r->c->head, memory_order_acquire);
+            avail = r->cached - r->pos;
+            if (avail == 0) {
+                ring_release(r);
+                ring_wait(&r->c->head, r->cached, &r->c->cons_waiting, r->policy);
+                continue;
+            }
+        }
+        uint32_t n = len < avail ? (uint32_t)len : avail;
+        uint32_t off = r->pos & r->mask;
+        uint32_t first = n < r->cap - off ? n : r->cap - off;
+        memcpy(p, r->c->data + off, first);
+        memcpy(p + first, r->c->data, n - first);
+        r->pos += n;
+        p += n;
+        len -= n;
+    }
+}
+
+/* Queues one message; it becomes visible at the next flush. */
+static void ring_send(ring_end_t *r, const void *buf, uint32_t len, int flush) {
+    ring_put(r, &len, sizeof(len));
+    ring_put(r, buf, len);
+    if (flush) ring_publish(r);
+}
+
+/* Receives one message into buf (at least maxlen bytes); returns its length. */
+static uint32_t ring_recv(ring_end_t *r, void *buf, uint32_t maxlen) {
+    uint32_t len;
+    ring_get(r, &len, sizeof(len));
+    if (len > maxlen) {
+        fprintf(stderr, "ring_comm: message of %u bytes exceeds buffer\n", len);
+        exit(EXIT_FAILURE);
+    }
+    ring_get(r, buf, len);
+    ring_release(r);
+    return len;
+}
+
+static ring_end_t ring_end(ring_ctrl_t *c, uint32_t cap, int policy) {
+    ring_end_t r = {c, cap, cap - 1, 0, 0, 0, policy};
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    bench_t bench, stream;
+    bench_init(&bench, "ring_comm", &argc, argv);
+    stream = bench;
+    stream.out = NULL;
+    int iterations = 1000000;
+    int policy = WAIT_SPIN;
+    size_t msg = 1, stream_msg = 4096, batch = 16;
+    size_t stream_total = (size_t)1 << 30;
+    size_t ring_bytes = (size_t)1 << 20;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--policy=", 9) == 0) {
+            const char *v = argv[i] + 9;
+            if (strcmp(v, "busy") == 0) policy = WAIT_BUSY;
+            else if (strcmp(v, "spin") == 0) policy = WAIT_SPIN;
+            else if (strcmp(v, "futex") == 0) policy = WAIT_FUTEX;
+            else { fprintf(stderr, "Unknown policy: %s\n", v); return EXIT_FAILURE; }
+        } else if (strncmp(argv[i], "--msg=", 6) == 0) {
+            msg = strtoull(argv[i] + 6, NULL, 10);
+        } else if (strncmp(argv[i], "--stream-msg=", 13) == 0) {
+            stream_msg = strtoull(argv[i] + 13, NULL, 10);
+        } else if (strncmp(argv[i], "--stream-total=", 15) == 0) {
+            stream_total = strtoull(argv[i] + 15, NULL, 10);
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batch = strtoull(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--ring=", 7) == 0) {
+            ring_bytes = strtoull(argv[i] + 7, NULL, 10);
+        } else {
+            iterations = atoi(argv[i]);
+        }
+    }
+    if (iterations <= 0 || msg == 0 || stream_msg == 0 || batch == 0 ||
+        msg > UINT32_MAX || stream_msg > UINT32_MAX ||
+        ring_bytes < 64 || ring_bytes > ((size_t)1 << 31) ||
+        (ring_bytes & (ring_bytes - 1)) != 0) {
+        fprintf(stderr, "Invalid arguments (ring size must be a power of two)\n");
+        return EXIT_FAILURE;
+    }
+    bench_config(&bench, "iterations", "%d", iterations);
+    bench_config(&bench, "policy", "%s", policy_names[policy]);
+    bench_config(&bench, "msg", "%zu", msg);
+    bench_config(&bench, "stream_msg", "%zu", stream_msg);
+    bench_config(&bench, "stream_total", "%zu", stream_total);
+    bench_config(&bench, "batch", "%zu", batch);
+    bench_config(&bench, "ring", "%zu", ring_bytes);
+    uint32_t cap = (uint32_t)ring_bytes;
+    size_t nstream = (stream_total + stream_msg - 1) / stream_msg;
+
+    size_t ring_size = (sizeof(ring_ctrl_t) + cap + 4095) & ~(size_t)4095;
+    unsigned char *mem = mmap(NULL, 2 * ring_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    ring_ctrl_t *ping = (ring_ctrl_t *)mem;              /* parent -> child */
+    ring_ctrl_t *pong = (ring_ctrl_t *)(mem + ring_size); /* child -> parent */
+
+    size_t bufsize = msg > stream_msg ? msg : stream_msg;
+    unsigned char *buf = calloc(bufsize, 1);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+
+    if (pid == 0) {
+        ring_end_t in = ring_end(ping, cap, policy);
+        ring_end_t out = ring_end(pong, cap, policy);
+        for (int r = 0; r < bench_runs(&bench); ++r) {
+            for (int i = 0; i < iterations; ++i) {
+                uint32_t n = ring_recv(&in, buf, bufsize);
+                ring_send(&out, buf, n, 1);
+            }
+            uint64_t received = 0;
+            for (size_t i = 0; i < nstream; ++i) received += ring_recv(&in, buf, bufsize);
+            ring_send(&out, &received, sizeof(received), 1);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    ring_end_t out = ring_end(ping, cap, policy);
+    ring_end_t in = ring_end(pong, cap, policy);
+
+    uint64_t sent = 0;
+    for (int r = 0; r < bench_runs(&bench); ++r) {
+        double t0 = bench_now();
+        for (int i = 0; i < iterations; ++i) {
+            ring_send(&out, buf, (uint32_t)msg, 1);
+            ring_recv(&in, buf, bufsize);
+        }
+        bench_record(&bench, r, (bench_now() - t0) / iterations);
+
+        uint64_t received = 0;
+        sent = 0;
+        t0 = bench_now();
+        for (size_t i = 0; i < nstream; ++i) {
+            uint32_t n = (uint32_t)(stream_total - sent < stream_msg ? stream_total - sent : stream_msg);
+            ring_send(&out, buf, n, (i + 1) % batch == 0 || i + 1 == nstream);
+            sent += n;
+        }
+        ring_recv(&in, &received, sizeof(received));
+        bench_record(&stream, r, bench_now() - t0);
+        if (received != sent) {
+            fprintf(stderr, "ring_comm: sent %llu bytes, child received %llu\n",
+                    (unsigned long long)sent, (unsigned long long)received);
+            return EXIT_FAILURE;
+        }
+    }
+    double avg = bench_median(&bench);
+    printf("ring_comm iterations=%d avg_time=%.9f sec policy=%s msg=%zu\n",
+           iterations, avg, policy_names[policy], msg);
+    double dt = bench_median(&stream);
+    printf("ring_comm stream bytes=%llu msg=%zu batch=%zu time=%.6f sec bandwidth=%.3f GB/s\n",
+           (unsigned long long)sent, stream_msg, batch, dt, sent / dt * 1e-9);
+    bench_metric(&bench, "stream_time", dt);
+    bench_metric(&bench, "bandwidth_GBps", sent / dt * 1e-9);
+    bench_finish(&bench);
+    free(stream.samples);
+
+    wait(NULL);
+    free(buf);
+    munmap(mem, 2 * ring_size);
+    return EXIT_SUCCESS;
+}
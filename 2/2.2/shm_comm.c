@@ -1,7 +1,20 @@
+/*
+ * Round-trip latency between two threads handing a byte over through a
+ * mutex and condition variable.
+ *
+ * Compilation:
+ *    gcc -O2 -o shm_comm shm_comm.c -lpthread -lm
+ *
+ * Usage:
+ *    ./shm_comm [iterations] [--bind=none|compact|scatter|core]
+ *               [--reps=R] [--warmup=W] [--bench-out=FILE]
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include "../../common/bench.h"
+#include "../../common/placement.h"
 
 #define DEFAULT_ITERS 1000000
 
@@ -14,31 +27,36 @@ typedef struct {
 
 int iterations;
 shm_t *shm;
+bench_t bench;
+place_t place;  // --bind: thread1 is worker 0, thread2 worker 1
 
 void *thread1_func(void *arg) {
     char buf = 0;
-    struct timeval t0, t1;
-    double total = 0.0;
+    place_bind(&place, 0);
 
-    for (int i = 0; i < iterations; ++i) {
-        gettimeofday(&t0, NULL);
-        pthread_mutex_lock(&shm->mutex);
-        shm->data = buf;
-        shm->flag = 1;
-        pthread_cond_signal(&shm->cond);
-        while (shm->flag != 0) pthread_cond_wait(&shm->cond, &shm->mutex);
-        pthread_mutex_unlock(&shm->mutex);
-        gettimeofday(&t1, NULL);
-        total += (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) * 1e-6;
+    // One sample per run: mean round trip over `iterations` exchanges
+    for (int r = 0; r < bench_runs(&bench); ++r) {
+        double t0 = bench_now();
+        for (int i = 0; i < iterations; ++i) {
+            pthread_mutex_lock(&shm->mutex);
+            shm->data = buf;
+            shm->flag = 1;
+            pthread_cond_signal(&shm->cond);
+            while (shm->flag != 0) pthread_cond_wait(&shm->cond, &shm->mutex);
+            pthread_mutex_unlock(&shm->mutex);
+        }
+        bench_record(&bench, r, (bench_now() - t0) / iterations);
     }
-    double avg = total / iterations;
+    double avg = bench_median(&bench);
     printf("shm_comm iterations=%d avg_time=%.9f sec\n", iterations, avg);
     return NULL;
 }
 
 void *thread2_func(void *arg) {
     char buf;
-    for (int i = 0; i < iterations; ++i) {
+    place_bind(&place, 1);
+    long total_iterations = (long)iterations * bench_runs(&bench);
+    for (long i = 0; i < total_iterations; ++i) {
         pthread_mutex_lock(&shm->mutex);
         while (shm->flag != 1) pthread_cond_wait(&shm->cond, &shm->mutex);
         buf = shm->data;
@@ -50,8 +68,13 @@ void *thread2_func(void *arg) {
 }
 
 int main(int argc, char **argv) {
+    bench_init(&bench, "shm_comm", &argc, argv);
+    if (place_init(&place, &argc, argv) != 0) return 1;
     iterations = DEFAULT_ITERS;
     if (argc >= 2) iterations = atoi(argv[1]);
+    bench_config(&bench, "iterations", "%d", iterations);
+    bench_config(&bench, "bind", "%s", place_policy_names[place.policy]);
+    place_print(&place, 2);
 
     shm = malloc(sizeof(*shm));
     pthread_mutex_init(&shm->mutex, NULL);
@@ -64,6 +87,7 @@ int main(int argc, char **argv) {
     pthread_create(&t1, NULL, thread1_func, NULL);
     pthread_join(t1, NULL);
     pthread_join(t2, NULL);
+    bench_finish(&bench);
 
     pthread_mutex_destroy(&shm->mutex);
     pthread_cond_destroy(&shm->cond);
@@ -1,121 +1,673 @@
 /*
  * Compilation:
  *    gcc -O2 -o adaptive_integral adaptive_integral.c -lpthread -lm
+ *    (add -DPERF_REGIONS for per-phase hardware counters, Linux only)
  *
  * Usage:
- *    ./adaptive_integral a b eps num_threads
+ *    ./adaptive_integral a b eps num_threads [--sum=naive|repro] [--mode=task|batch]
+ *                        [--f=NAME] [--rule=simpson|gk15|gk21]
+ *                        [--bind=none|compact|scatter|core]
+ *                        [--reps=R] [--warmup=W] [--bench-out=FILE]
+ *
+ * The integrand is chosen from the integrands[] table in quadrature.h
+ * (default sin_inv, sin(1/x)); an unknown --f= lists the table. Rules:
+ *    simpson  3-point Simpson with Richardson correction, error |S2 - S1|/15
+ *    gk15     7-point Gauss / 15-point Kronrod
+ *    gk21     10-point Gauss / 21-point Kronrod
+ * Gauss-Kronrod errors are estimated as in QUADPACK's qk15/qk21. A piece is
+ * accepted once its error estimate is below its tolerance; otherwise it is
+ * bisected and each half gets half the tolerance. The number of integrand
+ * evaluations is reported along with the task count.
+ *
+ * Scheduling: every worker owns a Chase-Lev deque of subintervals. A worker
+ * refines depth-first, keeping the left half and pushing the right half to
+ * the bottom of its own deque; idle workers steal from the top of a random
+ * victim's deque. Accepted pieces go to a per-worker partial sum, reduced
+ * in worker order at the end. With --sum=repro each piece is deposited in
+ * an exact per-worker accumulator (common/reprosum.h) instead; the set of
+ * accepted pieces does not depend on scheduling, so the result is then
+ * bitwise identical for any thread count.
+ *
+ * Task records come from per-worker slabs of SLAB_TASKS entries and are
+ * recycled through a per-worker free list; a task stolen by another worker
+ * is released to the thief's list. Slabs are never moved or returned, so
+ * their total is the peak number of live tasks (rounded up to slabs) and
+ * is reported at the end. Since refinement is depth-first this stays at
+ * about the tree depth per worker even for very small eps.
+ *
+ * With --bind (common/placement.h) worker i is pinned to the i-th CPU of
+ * the chosen order. Its slabs and deque growth are then first touched on
+ * that CPU's node, since workers allocate them themselves; the data here
+ * is small, so --hugepages is accepted but has nothing to act on.
+ *
+ * Termination: a worker that finds its deque empty counts itself idle
+ * before searching for a victim and uncounts itself before every steal
+ * attempt. Tasks only exist in the deques of non-idle workers or in their
+ * hands, so once all workers are counted idle no work is left anywhere.
+ *
+ * --mode=batch refines level by level instead. The intervals of one level
+ * are kept as a structure of arrays; workers claim blocks of BATCH
+ * intervals through an atomic counter, evaluate all 2·BATCH new points
+ * with one f_batch() call (AVX2 sin when available), run the Simpson
+ * accept/refine test over the block as a vector kernel, and append the
+ * children to a private buffer. Between levels the buffers are
+ * concatenated into the next level. Batch mode supports only Simpson.
+ *
+ * Built with -DPERF_REGIONS, each worker counts cycles, instructions, LLC
+ * and branch misses separately for getting a task (pop: own deque or
+ * steals), evaluating it (eval) and queueing the right half (push); batch
+ * mode has eval, push (appending children) and level (barriers and the
+ * copy into the next level). Task-mode regions are a single task long, so
+ * the counter reads dominate them: use the counts to compare the phases,
+ * not the total time.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <immintrin.h>
+#include "../../common/reprosum.h"
+#include "../../common/bench.h"
+#include "../../common/perfctr.h"
+#include "../../common/placement.h"
+#include "quadrature.h"
+
+#define BATCH 512
+#define SLAB_TASKS 1024
+
+/* Counter regions, built with -DPERF_REGIONS (see common/perfctr.h). */
+enum { R_POP, R_EVAL, R_PUSH, R_LEVEL, NREGIONS };
+static const char *region_names[NREGIONS] = {"pop", "eval", "push", "level"};
+
+/* Chase-Lev deque (Le, Pop, Cohen, Zappa Nardelli, PPoPP 2013). */
+
+typedef struct DequeArray {
+    long size;                  /* power of two */
+    struct DequeArray *retired; /* older arrays, freed with the deque */
+    _Atomic(Task *) buf[];
+} DequeArray;
+
+typedef struct {
+    atomic_long top, bottom;
+    _Atomic(DequeArray *) array;
+} Deque;
+
+#define STEAL_ABORT ((Task *)1)
+
+static DequeArray *deque_array_new(long size) {
+    DequeArray *a = malloc(sizeof(DequeArray) + size * sizeof(Task *));
+    a->size = size;
+    a->retired = NULL;
+    return a;
+}
+
+static void deque_init(Deque *q) {
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    atomic_init(&q->array, deque_array_new(64));
+}
+
+static void deque_destroy(Deque *q) {
+    DequeArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    while (a) {
+        DequeArray *next = a->retired;
+        free(a);
+        a = next;
+    }
+}
+
+/* Owner only. Thieves may still read the old array, so it is kept. */
+static DequeArray *deque_grow(Deque *q, DequeArray *a, long t, long b) {
+    DequeArray *n = deque_array_new(2 * a->size);
+    for (long i = t; i < b; ++i) {
+        Task *x = atomic_load_explicit(&a->buf[i & (a->size - 1)], memory_order_relaxed);
+        atomic_store_explicit(&n->buf[i & (n->size - 1)], x, memory_order_relaxed);
+    }
+    n->retired = a;
+    atomic_store_explicit(&q->array, n, memory_order_release);
+    return n;
+}
+
+/* Owner only. */
+static void deque_push(Deque *q, Task *x) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    DequeArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    if (b - t > a->size - 1) a = deque_grow(q, a, t, b);
+    atomic_store_explicit(&a->buf[b & (a->size - 1)], x, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+}
+
+/* Owner only; NULL if empty. */
+static Task *deque_take(Deque *q) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    DequeArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    Task *x = NULL;
+    if (t <= b) {
+        x = atomic_load_explicit(&a->buf[b & (a->size - 1)], memory_order_relaxed);
+        if (t == b) {
+            if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                         memory_order_seq_cst,
+                                                         memory_order_relaxed))
+                x = NULL;
+            atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return x;
+}
+
+/* Any thread; NULL if empty, STEAL_ABORT if it lost a race. */
+static Task *deque_steal(Deque *q) {
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+    DequeArray *a = atomic_load_explicit(&q->array, memory_order_acquire);
+    Task *x = atomic_load_explicit(&a->buf[t & (a->size - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+        return STEAL_ABORT;
+    return x;
+}
+
+static int deque_maybe_nonempty(Deque *q) {
+    return atomic_load_explicit(&q->bottom, memory_order_relaxed) >
+           atomic_load_explicit(&q->top, memory_order_relaxed);
+}
+
+/* Per-worker storage for Task records. */
+
+typedef union TaskSlot {
+    Task t;
+    union TaskSlot *next;
+} TaskSlot;
+
+typedef struct TaskSlab {
+    struct TaskSlab *next;
+    TaskSlot slot[SLAB_TASKS];
+} TaskSlab;
+
+typedef struct {
+    TaskSlot *free;
+    TaskSlab *slabs;
+    long nslabs;
+} TaskArena;
+
+static Task *task_alloc(TaskArena *ar) {
+    if (!ar->free) {
+        TaskSlab *s = malloc(sizeof(TaskSlab));
+        if (!s) { fprintf(stderr, "Out of memory (task slab %ld)\n", ar->nslabs); exit(EXIT_FAILURE); }
+        s->next = ar->slabs;
+        ar->slabs = s;
+        ar->nslabs++;
+        for (int i = 0; i < SLAB_TASKS - 1; ++i) s->slot[i].next = &s->slot[i + 1];
+        s->slot[SLAB_TASKS - 1].next = NULL;
+        ar->free = &s->slot[0];
+    }
+    TaskSlot *x = ar->free;
+    ar->free = x->next;
+    return &x->t;
+}
+
+static void task_free(TaskArena *ar, Task *t) {
+    TaskSlot *x = (TaskSlot *)t;
+    x->next = ar->free;
+    ar->free = x;
+}
+
+static void arena_destroy(TaskArena *ar) {
+    while (ar->slabs) {
+        TaskSlab *next = ar->slabs->next;
+        free(ar->slabs);
+        ar->slabs = next;
+    }
+}
+
+typedef struct {
+    Deque dq;
+    TaskArena arena;
+    double sum;
+    reprosum_t acc;
+    long tasks, steals, evals;
+    unsigned long long rng;
+} __attribute__((aligned(64))) Worker;
+
+static Worker *workers = NULL;
+static int nworkers = 0;
+static atomic_int nidle;
+static int repro_sum = 0;
+static place_t place;
+
+static void f_batch_scalar(const double *x, double *y, int n) {
+    for (int i = 0; i < n; ++i) y[i] = f(x[i]);
+}
 
+/* Intervals of one refinement level, structure of arrays. */
 typedef struct {
-    double a, b, fa, fb, fm, S, tol;
-} Task;
+    double *a, *b, *fa, *fb, *fm, *S, *tol;
+    long n, cap;
+} Level;
 
-static Task *stack = NULL;
-static int stack_top = 0;
-static int stack_cap = 0;
-static pthread_mutex_t stack_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void level_reserve(Level *L, long cap) {
+    if (cap <= L->cap) return;
+    long c = L->cap ? L->cap : BATCH;
+    while (c < cap) c *= 2;
+    double **arr[] = {&L->a, &L->b, &L->fa, &L->fb, &L->fm, &L->S, &L->tol};
+    for (int k = 0; k < 7; ++k) {
+        *arr[k] = realloc(*arr[k], c * sizeof(double));
+        if (!*arr[k]) { fprintf(stderr, "Out of memory (level of %ld)\n", c); exit(EXIT_FAILURE); }
+    }
+    L->cap = c;
+}
 
-static double global_result = 0.0;
-static pthread_mutex_t result_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void level_push(Level *L, double a, double b, double fa, double fb,
+                       double fm, double S, double tol) {
+    if (L->n == L->cap) level_reserve(L, L->n + 1);
+    long i = L->n++;
+    L->a[i] = a; L->b[i] = b; L->fa[i] = fa; L->fb[i] = fb;
+    L->fm[i] = fm; L->S[i] = S; L->tol[i] = tol;
+}
 
-double f(double x) {
-    return sin(1.0/x);
+static void level_free(Level *L) {
+    free(L->a); free(L->b); free(L->fa); free(L->fb);
+    free(L->fm); free(L->S); free(L->tol);
 }
 
-double simpson(double a, double b, double fa, double fb, double fm) {
-    return (fa + 4.0*fm + fb) * (b - a) / 6.0;
+/*
+ * Simpson halves and accept test for intervals i0..i0+n of L, with
+ * fl/fr the values at the quarter points. Same arithmetic as worker().
+ */
+static void simpson_batch_scalar(const Level *L, long i0, int n, const double *fl,
+                                 const double *fr, double *Sl, double *Sr,
+                                 double *val, unsigned char *accept) {
+    for (int j = 0; j < n; ++j) {
+        long i = i0 + j;
+        double a = L->a[i], b = L->b[i];
+        double m = 0.5 * (a + b), lm = 0.5 * (a + m), rm = 0.5 * (m + b);
+        Sl[j] = simpson(a, m, L->fa[i], L->fm[i], fl[j]);
+        Sr[j] = simpson(m, b, L->fm[i], L->fb[i], fr[j]);
+        double d = Sl[j] + Sr[j] - L->S[i];
+        accept[j] = fabs(d) < 15.0 * L->tol[i] || !(a < lm && lm < m && m < rm && rm < b);
+        val[j] = Sl[j] + Sr[j] + d / 15.0;
+    }
 }
 
-void push_task(Task t) {
-    pthread_mutex_lock(&stack_mutex);
-    if (stack_top == stack_cap) {
-        int newcap = stack_cap ? stack_cap * 2 : 1;
-        stack = realloc(stack, newcap * sizeof(Task));
-        stack_cap = newcap;
+__attribute__((target("avx2")))
+static void simpson_batch_avx2(const Level *L, long i0, int n, const double *fl,
+                               const double *fr, double *Sl, double *Sr,
+                               double *val, unsigned char *accept) {
+    const __m256d half = _mm256_set1_pd(0.5), four = _mm256_set1_pd(4.0);
+    const __m256d six = _mm256_set1_pd(6.0), fifteen = _mm256_set1_pd(15.0);
+    const __m256d absmask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        long i = i0 + j;
+        __m256d a = _mm256_loadu_pd(L->a + i), b = _mm256_loadu_pd(L->b + i);
+        __m256d fa = _mm256_loadu_pd(L->fa + i), fb = _mm256_loadu_pd(L->fb + i);
+        __m256d fm = _mm256_loadu_pd(L->fm + i), S = _mm256_loadu_pd(L->S + i);
+        __m256d vl = _mm256_loadu_pd(fl + j), vr = _mm256_loadu_pd(fr + j);
+        __m256d m = _mm256_mul_pd(half, _mm256_add_pd(a, b));
+        __m256d sl = _mm256_div_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(fa, _mm256_mul_pd(four, vl)), fm),
+                                                 _mm256_sub_pd(m, a)), six);
+        __m256d sr = _mm256_div_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(fm, _mm256_mul_pd(four, vr)), fb),
+                                                 _mm256_sub_pd(b, m)), six);
+        __m256d sum = _mm256_add_pd(sl, sr);
+        __m256d d = _mm256_sub_pd(sum, S);
+        __m256d ok = _mm256_cmp_pd(_mm256_and_pd(d, absmask),
+                                   _mm256_mul_pd(fifteen, _mm256_loadu_pd(L->tol + i)), _CMP_LT_OQ);
+        _mm256_storeu_pd(Sl + j, sl);
+        _mm256_storeu_pd(Sr + j, sr);
+        _mm256_storeu_pd(val + j, _mm256_add_pd(sum, _mm256_div_pd(d, fifteen)));
+        /* As in refine(): accept pieces whose quarter points collapse. */
+        __m256d lm = _mm256_mul_pd(half, _mm256_add_pd(a, m));
+        __m256d rm = _mm256_mul_pd(half, _mm256_add_pd(m, b));
+        __m256d sep = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(a, lm, _CMP_LT_OQ),
+                                                  _mm256_cmp_pd(lm, m, _CMP_LT_OQ)),
+                                    _mm256_and_pd(_mm256_cmp_pd(m, rm, _CMP_LT_OQ),
+                                                  _mm256_cmp_pd(rm, b, _CMP_LT_OQ)));
+        int mask = _mm256_movemask_pd(ok) | (~_mm256_movemask_pd(sep) & 0xF);
+        for (int k = 0; k < 4; ++k) accept[j + k] = (mask >> k) & 1;
+    }
+    simpson_batch_scalar(L, i0 + j, n - j, fl + j, fr + j, Sl + j, Sr + j, val + j, accept + j);
+}
+
+typedef void (*simpson_batch_fn)(const Level *, long, int, const double *, const double *,
+                                 double *, double *, double *, unsigned char *);
+
+/* pthread_barrier_t is missing on macOS. */
+typedef struct {
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    int n, waiting;
+    unsigned phase;
+} Barrier;
+
+static void barrier_wait(Barrier *bar) {
+    pthread_mutex_lock(&bar->mu);
+    unsigned phase = bar->phase;
+    if (++bar->waiting == bar->n) {
+        bar->waiting = 0;
+        bar->phase++;
+        pthread_cond_broadcast(&bar->cv);
+    } else {
+        while (phase == bar->phase) pthread_cond_wait(&bar->cv, &bar->mu);
     }
-    stack[stack_top++] = t;
-    pthread_mutex_unlock(&stack_mutex);
+    pthread_mutex_unlock(&bar->mu);
 }
 
-int pop_task(Task *t) {
-    pthread_mutex_lock(&stack_mutex);
-    if (stack_top == 0) {
-        pthread_mutex_unlock(&stack_mutex);
-        return 0;
+static int random_victim(Worker *w, int self) {
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    int v = (int)(w->rng % (unsigned long long)(nworkers - 1));
+    return v >= self ? v + 1 : v;
+}
+
+/* Called with an empty own deque; NULL means the computation is over. */
+static Task *find_work(Worker *w, int self) {
+    atomic_fetch_add(&nidle, 1);
+    for (int attempt = 1; ; ++attempt) {
+        if (atomic_load(&nidle) == nworkers) return NULL;
+        int v = random_victim(w, self);
+        if (deque_maybe_nonempty(&workers[v].dq)) {
+            atomic_fetch_sub(&nidle, 1);
+            Task *x = deque_steal(&workers[v].dq);
+            if (x && x != STEAL_ABORT) {
+                w->steals++;
+                return x;
+            }
+            atomic_fetch_add(&nidle, 1);
+        }
+        if (attempt % nworkers == 0) sched_yield();
     }
-    *t = stack[--stack_top];
-    pthread_mutex_unlock(&stack_mutex);
-    return 1;
 }
 
 void *worker(void *arg) {
-    Task task;
-    while (pop_task(&task)) {
-        double a = task.a, b = task.b;
-        double m  = 0.5 * (a + b);
-        double lm = 0.5 * (a + m), rm = 0.5 * (m + b);
-        double fl = f(lm), fr = f(rm);
-        double Sleft  = simpson(a,  m,  task.fa, task.fm, fl);
-        double Sright = simpson(m,  b,  task.fm, task.fb, fr);
-        if (fabs(Sleft + Sright - task.S) < 15.0 * task.tol) {
-            double val = Sleft + Sright + (Sleft + Sright - task.S) / 15.0;
-            pthread_mutex_lock(&result_mutex);
-            global_result += val;
-            pthread_mutex_unlock(&result_mutex);
+    Worker *w = arg;
+    int self = (int)(w - workers);
+    Task *task = NULL;
+    place_bind(&place, self);
+    PERF_THREAD(self);
+    for (;;) {
+        PERF_BEGIN(R_POP);
+        if (!task) task = deque_take(&w->dq);
+        if (!task && nworkers > 1) task = find_work(w, self);
+        PERF_END(R_POP);
+        if (!task) break;
+
+        w->tasks++;
+        w->evals += rule->evals;
+        double val;
+        Task left, right;
+        PERF_BEGIN(R_EVAL);
+        int done = refine(task, &val, &left, &right);
+        PERF_END(R_EVAL);
+        if (done) {
+            if (repro_sum) reprosum_add(&w->acc, val);
+            else           w->sum += val;
+            task_free(&w->arena, task);
+            task = NULL;
         } else {
-            Task t1 = {a,    m, task.fa, task.fm, fl, Sleft,  task.tol / 2.0};
-            Task t2 = {m,    b, task.fm, task.fb, fr, Sright, task.tol / 2.0};
-            push_task(t1);
-            push_task(t2);
+            PERF_BEGIN(R_PUSH);
+            Task *r = task_alloc(&w->arena);
+            *r = right;
+            *task = left;
+            deque_push(&w->dq, r);
+            PERF_END(R_PUSH);
         }
     }
     return NULL;
 }
 
+static Level levels[2];         /* current and next level, by parity */
+static Level *batch_out = NULL; /* per-worker children of the current level */
+static atomic_long next_block;
+static Barrier level_bar;
+static int nlevels = 0;
+static size_t batch_peak_bytes = 0;
+static f_batch_fn f_batch = f_batch_scalar;
+static simpson_batch_fn simpson_batch = simpson_batch_scalar;
+
+void *batch_worker(void *arg) {
+    Worker *w = arg;
+    int self = (int)(w - workers);
+    Level *out = &batch_out[self];
+    double *x = malloc(2 * BATCH * sizeof(double));
+    double *y = malloc(2 * BATCH * sizeof(double));
+    double *Sl = malloc(3 * BATCH * sizeof(double));
+    double *Sr = Sl + BATCH, *val = Sl + 2 * BATCH;
+    unsigned char accept[BATCH];
+
+    place_bind(&place, self);
+    PERF_THREAD(self);
+    for (int lvl = 0; ; ++lvl) {
+        Level *cur = &levels[lvl & 1], *next = &levels[(lvl + 1) & 1];
+        for (;;) {
+            long i0 = atomic_fetch_add(&next_block, 1) * BATCH;
+            if (i0 >= cur->n) break;
+            int n = cur->n - i0 < BATCH ? (int)(cur->n - i0) : BATCH;
+            for (int j = 0; j < n; ++j) {
+                double a = cur->a[i0 + j], b = cur->b[i0 + j];
+                double m = 0.5 * (a + b);
+                x[j]     = 0.5 * (a + m);
+                x[n + j] = 0.5 * (m + b);
+            }
+            PERF_BEGIN(R_EVAL);
+            f_batch(x, y, 2 * n);
+            simpson_batch(cur, i0, n, y, y + n, Sl, Sr, val, accept);
+            PERF_END(R_EVAL);
+            PERF_BEGIN(R_PUSH);
+            for (int j = 0; j < n; ++j) {
+                if (accept[j]) {
+                    if (repro_sum) reprosum_add(&w->acc, val[j]);
+                    else           w->sum += val[j];
+                } else {
+                    long i = i0 + j;
+                    double a = cur->a[i], b = cur->b[i], m = 0.5 * (a + b);
+                    double tol = cur->tol[i] / 2.0;
+                    level_push(out, a, m, cur->fa[i], cur->fm[i], y[j],     Sl[j], tol);
+                    level_push(out, m, b, cur->fm[i], cur->fb[i], y[n + j], Sr[j], tol);
+                }
+            }
+            PERF_END(R_PUSH);
+            w->tasks += n;
+            w->evals += 2 * n;
+        }
+        PERF_BEGIN(R_LEVEL);
+        barrier_wait(&level_bar);
+
+        /* Worker 0 sizes the next level; each worker then copies its children at its offset. */
+        if (self == 0) {
+            long total = 0;
+            for (int t = 0; t < nworkers; ++t) total += batch_out[t].n;
+            level_reserve(next, total);
+            next->n = total;
+            atomic_store(&next_block, 0);
+            nlevels = lvl + 1;
+            long cap = levels[0].cap + levels[1].cap;
+            for (int t = 0; t < nworkers; ++t) cap += batch_out[t].cap;
+            size_t bytes = 7 * sizeof(double) * (size_t)cap;
+            if (bytes > batch_peak_bytes) batch_peak_bytes = bytes;
+        }
+        barrier_wait(&level_bar);
+
+        long off = 0;
+        for (int t = 0; t < self; ++t) off += batch_out[t].n;
+        size_t bytes = out->n * sizeof(double);
+        memcpy(next->a + off, out->a, bytes);
+        memcpy(next->b + off, out->b, bytes);
+        memcpy(next->fa + off, out->fa, bytes);
+        memcpy(next->fb + off, out->fb, bytes);
+        memcpy(next->fm + off, out->fm, bytes);
+        memcpy(next->S + off, out->S, bytes);
+        memcpy(next->tol + off, out->tol, bytes);
+        barrier_wait(&level_bar);
+        PERF_END(R_LEVEL);
+        out->n = 0;
+        if (next->n == 0) break;
+    }
+    free(x);
+    free(y);
+    free(Sl);
+    return NULL;
+}
+
 int main(int argc, char **argv) {
+    bench_t bench;
+    bench_init(&bench, "adaptive_integral", &argc, argv);
+    if (place_init(&place, &argc, argv) != 0) return EXIT_FAILURE;
     if (argc < 5) {
-        fprintf(stderr, "Usage: %s a b eps num_threads\n", argv[0]);
+        fprintf(stderr, "Usage: %s a b eps num_threads [--sum=naive|repro] [--mode=task|batch]"
+                        " [--f=NAME] [--rule=simpson|gk15|gk21]"
+                        " [--bind=none|compact|scatter|core]"
+                        " [--reps=R] [--warmup=W] [--bench-out=FILE]\n", argv[0]);
         return EXIT_FAILURE;
     }
     double a   = atof(argv[1]);
     double b   = atof(argv[2]);
     double eps = atof(argv[3]);
     int    P   = atoi(argv[4]);
-    if (a <= 0.0 || b <= a || eps <= 0.0 || P <= 0) {
+    int batch = 0;
+    for (int i = 5; i < argc; ++i) {
+        int q = quad_option(argv[i]);
+        if (q < 0) return EXIT_FAILURE;
+        if (q > 0) continue;
+        if (strcmp(argv[i], "--mode=batch") == 0) batch = 1;
+        else if (strcmp(argv[i], "--mode=task") == 0) batch = 0;
+        else if (strcmp(argv[i], "--sum=repro") == 0) repro_sum = 1;
+        else if (strcmp(argv[i], "--sum=naive") == 0) repro_sum = 0;
+        else { fprintf(stderr, "Unknown option: %s\n", argv[i]); return EXIT_FAILURE; }
+    }
+    if (batch && rule->nk != 0) {
+        fprintf(stderr, "--mode=batch supports only --rule=simpson\n");
+        return EXIT_FAILURE;
+    }
+    if (!quad_domain_ok(a, b) || eps <= 0.0 || P <= 0) {
         fprintf(stderr, "Invalid arguments\n");
         return EXIT_FAILURE;
     }
-    double fa = f(a), fb = f(b);
-    double m  = 0.5 * (a + b), fm = f(m);
-    double S  = simpson(a, b, fa, fb, fm);
-    push_task((Task){a, b, fa, fb, fm, S, eps});
 
-    pthread_t *threads = malloc(P * sizeof(pthread_t));
-    struct timeval t0, t1;
-    gettimeofday(&t0, NULL);
+    bench_config(&bench, "a", "%.17g", a);
+    bench_config(&bench, "b", "%.17g", b);
+    bench_config(&bench, "eps", "%g", eps);
+    bench_config(&bench, "P", "%d", P);
+    bench_config(&bench, "mode", "%s", batch ? "batch" : "task");
+    bench_config(&bench, "sum", "%s", repro_sum ? "repro" : "naive");
+    bench_config(&bench, "f", "%s", integrand->name);
+    bench_config(&bench, "rule", "%s", rule->name);
+    bench_config(&bench, "bind", "%s", place_policy_names[place.policy]);
+    place_print(&place, P);
 
+    nworkers = P;
+    workers = aligned_alloc(64, P * sizeof(Worker));
     for (int i = 0; i < P; ++i) {
-        pthread_create(&threads[i], NULL, worker, NULL);
+        deque_init(&workers[i].dq);
+        workers[i].arena = (TaskArena){NULL, NULL, 0};
     }
-    for (int i = 0; i < P; ++i) {
-        pthread_join(threads[i], NULL);
+    if (batch) {
+        batch_out = calloc(P, sizeof(Level));
+        pthread_mutex_init(&level_bar.mu, NULL);
+        pthread_cond_init(&level_bar.cv, NULL);
+        level_bar.n = P;
+        level_bar.waiting = 0;
+        level_bar.phase = 0;
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            if (integrand->batch_avx2) f_batch = integrand->batch_avx2;
+            simpson_batch = simpson_batch_avx2;
+        }
     }
 
-    gettimeofday(&t1, NULL);
-    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) * 1e-6;
+    /* Deques, task slabs and level buffers are kept between repetitions. */
+    pthread_t *threads = malloc(P * sizeof(pthread_t));
+    long evals = 0;
+    for (int r = 0; r < bench_runs(&bench); ++r) {
+        atomic_init(&nidle, 0);
+        for (int i = 0; i < P; ++i) {
+            workers[i].sum = 0.0;
+            reprosum_init(&workers[i].acc);
+            workers[i].tasks = workers[i].steals = workers[i].evals = 0;
+            workers[i].rng = 0x9E3779B97F4A7C15ull * (i + 1);
+        }
+
+        evals = 0;
+        Task root = root_task(a, b, eps, &evals);
+        if (batch) {
+            levels[0].n = levels[1].n = 0;
+            level_push(&levels[0], root.a, root.b, root.fa, root.fb, root.fm, root.S, root.tol);
+            atomic_init(&next_block, 0);
+            nlevels = 0;
+        } else {
+            Task *t = task_alloc(&workers[0].arena);
+            *t = root;
+            deque_push(&workers[0].dq, t);
+        }
 
-    printf("Result integral = %.9f\n", global_result);
+        double t0 = bench_now();
+        for (int i = 0; i < P; ++i) {
+            pthread_create(&threads[i], NULL, batch ? batch_worker : worker, &workers[i]);
+        }
+        for (int i = 0; i < P; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+        bench_record(&bench, r, bench_now() - t0);
+    }
+    double elapsed = bench_median(&bench);
+
+    double result = 0.0;
+    long tasks = 0, steals = 0;
+    reprosum_t acc;
+    reprosum_init(&acc);
+    for (int i = 0; i < P; ++i) {
+        result += workers[i].sum;
+        reprosum_merge(&acc, &workers[i].acc);
+        tasks  += workers[i].tasks;
+        steals += workers[i].steals;
+        evals  += workers[i].evals;
+    }
+    if (repro_sum) result = reprosum_value(&acc);
+
+    printf("Result integral = %.*f\n", repro_sum ? 17 : 9, result);
     printf("Elapsed time = %.6f sec\n", elapsed);
+    if (batch) printf("Tasks = %ld, levels = %d\n", tasks, nlevels);
+    else       printf("Tasks = %ld, steals = %ld\n", tasks, steals);
+    printf("Evaluations = %ld (f = %s, rule = %s)\n", evals, integrand->expr, rule->name);
 
-    free(stack);
+    if (batch) {
+        printf("Peak interval memory = %.1f KiB\n", batch_peak_bytes / 1024.0);
+    } else {
+        long nslabs = 0;
+        for (int i = 0; i < P; ++i) nslabs += workers[i].arena.nslabs;
+        printf("Peak task memory = %.1f KiB (%ld slabs of %d tasks)\n",
+               nslabs * sizeof(TaskSlab) / 1024.0, nslabs, SLAB_TASKS);
+    }
+    bench_metric(&bench, "result", result);
+    bench_metric(&bench, "tasks", tasks);
+    bench_metric(&bench, "evals", evals);
+    bench_finish(&bench);
+    PERF_REPORT(region_names, NREGIONS);
+
+    for (int i = 0; i < P; ++i) {
+        deque_destroy(&workers[i].dq);
+        arena_destroy(&workers[i].arena);
+    }
+    if (batch) {
+        for (int i = 0; i < P; ++i) level_free(&batch_out[i]);
+        free(batch_out);
+        level_free(&levels[0]);
+        level_free(&levels[1]);
+    }
+    free(workers);
     free(threads);
-    pthread_mutex_destroy(&stack_mutex);
-    pthread_mutex_destroy(&result_mutex);
     return EXIT_SUCCESS;
-} 
\ No newline at end of file
+}
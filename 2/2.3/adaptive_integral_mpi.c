@@ -0,0 +1,343 @@
+/*
+ * Compilation:
+ *    mpicc -O2 -o adaptive_integral_mpi adaptive_integral_mpi.c -lm
+ *
+ * Usage:
+ *    mpirun -np P ./adaptive_integral_mpi a b eps [--sum=naive|repro]
+ *                                         [--f=NAME] [--rule=simpson|gk15|gk21]
+ *                                         [--reps=R] [--warmup=W] [--bench-out=FILE]
+ *
+ * Distributed version of adaptive_integral: integrands, rules and the
+ * accept/bisect step come from quadrature.h, so for the same options the
+ * set of accepted pieces is the same as with threads (and --sum=repro
+ * gives the same bits).
+ *
+ * Load balancing: every rank keeps a local stack of tasks and refines
+ * depth-first. Rank 0 starts with the whole interval. A rank whose stack
+ * runs empty sends a steal request to a random rank and keeps serving
+ * messages until the answer comes; a busy rank checks for requests every
+ * POLL_TASKS tasks and answers with the older (larger) half of its stack,
+ * an idle one answers with an empty message. All sends are nonblocking.
+ *
+ * Termination: Dijkstra-Safra token ring. Only messages that carry tasks
+ * are counted: the sender increments its counter, the receiver decrements
+ * it and turns black. The token travels 0 -> 1 -> ... -> P-1 -> 0 and is
+ * passed on only by idle ranks, adding their counter and colour and
+ * whitening them. Rank 0 ends the run when the token comes back white
+ * with a zero sum while rank 0 itself is idle and white. Steal requests
+ * still in flight at that point are answered before the final reduction.
+ * Every message of a run is consumed before it ends, so repetitions
+ * (--reps) simply restart from the root interval on rank 0.
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../common/reprosum.h"
+#include "../../common/bench.h"
+#include "quadrature.h"
+
+#define POLL_TASKS   64     /* tasks between two message checks */
+#define MAX_SHIP     4096   /* tasks per work message */
+#define TASK_DOUBLES ((int)(sizeof(Task) / sizeof(double)))
+
+enum { TAG_STEAL = 1, TAG_WORK, TAG_TOKEN, TAG_DONE };
+enum { WHITE = 0, BLACK = 1 };
+
+typedef struct {
+    Task *t;
+    long n, cap;
+} Pool;
+
+static void pool_reserve(Pool *p, long cap) {
+    if (cap <= p->cap) return;
+    long c = p->cap ? p->cap : 1024;
+    while (c < cap) c *= 2;
+    p->t = realloc(p->t, c * sizeof(Task));
+    if (!p->t) { fprintf(stderr, "Out of memory (pool of %ld)\n", c); MPI_Abort(MPI_COMM_WORLD, 1); }
+    p->cap = c;
+}
+
+static void pool_push(Pool *p, const Task *t) {
+    if (p->n == p->cap) pool_reserve(p, p->n + 1);
+    p->t[p->n++] = *t;
+}
+
+/* Nonblocking sends own a copy of their data until they complete. */
+typedef struct {
+    MPI_Request req;
+    void *buf;
+} Outgoing;
+
+static Outgoing *out = NULL;
+static int nout = 0, capout = 0;
+
+static void post_send(const void *data, int count, MPI_Datatype type, size_t bytes, int dest, int tag) {
+    if (nout == capout) {
+        capout = capout ? 2 * capout : 16;
+        out = realloc(out, capout * sizeof(Outgoing));
+    }
+    void *buf = malloc(bytes ? bytes : 1);
+    if (bytes) memcpy(buf, data, bytes);
+    MPI_Isend(buf, count, type, dest, tag, MPI_COMM_WORLD, &out[nout].req);
+    out[nout++].buf = buf;
+}
+
+static void reap_sends(int wait) {
+    int k = 0;
+    for (int i = 0; i < nout; ++i) {
+        int flag = 1;
+        if (wait) MPI_Wait(&out[i].req, MPI_STATUS_IGNORE);
+        else      MPI_Test(&out[i].req, &flag, MPI_STATUS_IGNORE);
+        if (flag) free(out[i].buf);
+        else      out[k++] = out[i];
+    }
+    nout = k;
+}
+
+/* State of this rank. */
+static int rank, nranks;
+static Pool pool;
+static long msg_count = 0;        /* task messages sent - received */
+static int color = WHITE;
+static int have_token = 0;
+static long token[2];             /* colour, count */
+static int steal_pending = 0;     /* a steal request is unanswered */
+static int done = 0;
+static long steals = 0;
+static unsigned long long rng;
+
+static int random_victim(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    int v = (int)(rng % (unsigned long long)(nranks - 1));
+    return v >= rank ? v + 1 : v;
+}
+
+/* Ships the bottom half of the pool (or nothing) to a thief. */
+static void answer_steal(int thief) {
+    long give = pool.n / 2;
+    if (give > MAX_SHIP) give = MAX_SHIP;
+    size_t bytes = give * sizeof(Task);
+    post_send(pool.t, (int)(give * TASK_DOUBLES), MPI_DOUBLE, bytes, thief, TAG_WORK);
+    if (give) {
+        memmove(pool.t, pool.t + give, (pool.n - give) * sizeof(Task));
+        pool.n -= give;
+        msg_count++;
+    }
+}
+
+/* Handles every message that has arrived. */
+static void progress(void) {
+    for (;;) {
+        int flag;
+        MPI_Status st;
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &st);
+        if (!flag) break;
+        switch (st.MPI_TAG) {
+        case TAG_STEAL:
+            MPI_Recv(NULL, 0, MPI_BYTE, st.MPI_SOURCE, TAG_STEAL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            answer_steal(st.MPI_SOURCE);
+            break;
+        case TAG_WORK: {
+            int count;
+            MPI_Get_count(&st, MPI_DOUBLE, &count);
+            long n = count / TASK_DOUBLES;
+            pool_reserve(&pool, pool.n + n);
+            MPI_Recv(pool.t + pool.n, count, MPI_DOUBLE, st.MPI_SOURCE, TAG_WORK,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            pool.n += n;
+            steal_pending = 0;
+            if (n) {
+                msg_count--;
+                color = BLACK;
+                steals++;
+            }
+            break;
+        }
+        case TAG_TOKEN:
+            MPI_Recv(token, 2, MPI_LONG, st.MPI_SOURCE, TAG_TOKEN, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            have_token = 1;
+            break;
+        case TAG_DONE:
+            MPI_Recv(NULL, 0, MPI_BYTE, st.MPI_SOURCE, TAG_DONE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            done = 1;
+            break;
+        }
+    }
+    reap_sends(0);
+}
+
+/* Called by an idle rank holding the token. */
+static void handle_token(void) {
+    if (rank == 0) {
+        if (token[0] == WHITE && color == WHITE && token[1] + msg_count == 0) {
+            for (int r = 1; r < nranks; ++r) post_send(NULL, 0, MPI_BYTE, 0, r, TAG_DONE);
+            done = 1;
+            return;
+        }
+        token[0] = WHITE;       /* start a new round */
+        token[1] = 0;
+    } else {
+        token[1] += msg_count;
+        if (color == BLACK) token[0] = BLACK;
+    }
+    color = WHITE;
+    have_token = 0;
+    post_send(token, 2, MPI_LONG, sizeof(token), (rank + 1) % nranks, TAG_TOKEN);
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    bench_t bench;
+    bench_init(&bench, "adaptive_integral_mpi", &argc, argv);
+
+    if (argc < 4) {
+        if (rank == 0)
+            fprintf(stderr, "Usage: %s a b eps [--sum=naive|repro] [--f=NAME]"
+                            " [--rule=simpson|gk15|gk21] [--reps=R] [--warmup=W] [--bench-out=FILE]\n", argv[0]);
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+    double a   = atof(argv[1]);
+    double b   = atof(argv[2]);
+    double eps = atof(argv[3]);
+    int repro_sum = 0;
+    for (int i = 4; i < argc; ++i) {
+        int q = quad_option(argv[i]);
+        if (q < 0) { MPI_Finalize(); return EXIT_FAILURE; }
+        if (q > 0) continue;
+        if (strcmp(argv[i], "--sum=repro") == 0) repro_sum = 1;
+        else if (strcmp(argv[i], "--sum=naive") == 0) repro_sum = 0;
+        else {
+            if (rank == 0) fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            MPI_Finalize();
+            return EXIT_FAILURE;
+        }
+    }
+    if (!quad_domain_ok(a, b) || eps <= 0.0) {
+        if (rank == 0) fprintf(stderr, "Invalid arguments\n");
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+    bench_config(&bench, "a", "%.17g", a);
+    bench_config(&bench, "b", "%.17g", b);
+    bench_config(&bench, "eps", "%g", eps);
+    bench_config(&bench, "sum", "%s", repro_sum ? "repro" : "naive");
+    bench_config(&bench, "f", "%s", integrand->name);
+    bench_config(&bench, "rule", "%s", rule->name);
+
+    double sum = 0.0;
+    reprosum_t acc;
+    long tasks = 0, evals = 0;
+    for (int r = 0; r < bench_runs(&bench); ++r) {
+        rng = 0x9E3779B97F4A7C15ull * (rank + 1);
+        sum = 0.0;
+        reprosum_init(&acc);
+        tasks = evals = steals = 0;
+        msg_count = 0;
+        color = WHITE;
+        have_token = steal_pending = done = 0;
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t0 = MPI_Wtime();
+
+        if (rank == 0) {
+            Task root = root_task(a, b, eps, &evals);
+            pool_push(&pool, &root);
+            have_token = 1;
+            token[0] = BLACK;       /* makes rank 0 start the first round when idle */
+            token[1] = 0;
+        }
+
+        while (!done) {
+            for (int k = 0; k < POLL_TASKS && pool.n > 0; ++k) {
+                Task t = pool.t[--pool.n], left, right;
+                double val;
+                tasks++;
+                evals += rule->evals;
+                if (refine(&t, &val, &left, &right)) {
+                    if (repro_sum) reprosum_add(&acc, val);
+                    else           sum += val;
+                } else {
+                    pool_push(&pool, &right);
+                    pool_push(&pool, &left);
+                }
+            }
+            if (nranks == 1) {
+                done = pool.n == 0;
+                continue;
+            }
+            progress();
+            if (pool.n == 0 && !done) {
+                if (!steal_pending) {
+                    post_send(NULL, 0, MPI_BYTE, 0, random_victim(), TAG_STEAL);
+                    steal_pending = 1;
+                }
+                if (have_token) handle_token();
+            }
+        }
+
+        /* Collect the answer to our own request and serve the others' until all have theirs. */
+        if (nranks > 1) {
+            while (steal_pending) progress();
+            MPI_Request bar;
+            MPI_Ibarrier(MPI_COMM_WORLD, &bar);
+            for (int fin = 0; !fin; ) {
+                progress();
+                MPI_Test(&bar, &fin, MPI_STATUS_IGNORE);
+            }
+            reap_sends(1);
+            if (pool.n != 0) {
+                fprintf(stderr, "Rank %d: %ld tasks left after termination\n", rank, pool.n);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+
+        double elapsed = MPI_Wtime() - t0, tmax_elapsed;
+        MPI_Allreduce(&elapsed, &tmax_elapsed, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        bench_record(&bench, r, tmax_elapsed);
+    }
+
+    double result = 0.0;
+    if (repro_sum) {
+        MPI_Datatype rs_type;
+        MPI_Op rs_op;
+        reprosum_mpi_init(&rs_type, &rs_op);
+        reprosum_t total;
+        reprosum_normalize(&acc);
+        MPI_Reduce(&acc, &total, 1, rs_type, rs_op, 0, MPI_COMM_WORLD);
+        if (rank == 0) result = reprosum_value(&total);
+        MPI_Op_free(&rs_op);
+        MPI_Type_free(&rs_type);
+    } else {
+        MPI_Reduce(&sum, &result, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    }
+    long local[3] = {tasks, evals, steals}, total[3], tmin, tmax;
+    MPI_Reduce(local, total, 3, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&tasks, &tmin, 1, MPI_LONG, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&tasks, &tmax, 1, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        printf("Result integral = %.*f\n", repro_sum ? 17 : 9, result);
+        printf("Elapsed time = %.6f sec\n", bench_median(&bench));
+        printf("Tasks = %ld, steals = %ld, tasks per rank min = %ld max = %ld\n",
+               total[0], total[2], tmin, tmax);
+        printf("Evaluations = %ld (f = %s, rule = %s)\n", total[1], integrand->expr, rule->name);
+        bench_metric(&bench, "result", result);
+        bench_metric(&bench, "tasks", total[0]);
+        bench_metric(&bench, "evals", total[1]);
+        bench_metric(&bench, "steals", total[2]);
+    }
+    bench_finish(&bench);
+
+    free(pool.t);
+    free(out);
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
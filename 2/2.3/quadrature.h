@@ -0,0 +1,279 @@
+/*
+ * Integrands and local rules shared by adaptive_integral (threads) and
+ * adaptive_integral_mpi (ranks).
+ *
+ * A Task is one subinterval with its tolerance; Simpson tasks also carry
+ * the integrand at a, b and the midpoint and the coarse estimate S, the
+ * Gauss-Kronrod rules need only a, b and tol. refine() applies the
+ * selected rule to a task and either accepts it or bisects it, giving
+ * each half half the tolerance.
+ *
+ * The integrand and the rule are process-wide (integrand, rule) and are
+ * set from --f=NAME and --rule=NAME by quad_option().
+ */
+
+#ifndef QUADRATURE_H
+#define QUADRATURE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <immintrin.h>
+
+#define SIN_VEC_MAX 8.0e5   /* Cody-Waite reduction below stays exact up to here */
+
+typedef struct {
+    double a, b, fa, fb, fm, S, tol;
+} Task;
+
+/* y[i] = f(x[i]) for i < n. */
+typedef void (*f_batch_fn)(const double *x, double *y, int n);
+
+typedef struct {
+    const char *name, *expr;
+    double (*f)(double);
+    f_batch_fn batch_avx2;   /* NULL: batch mode evaluates f() in a loop */
+} Integrand;
+
+static const Integrand *integrand;   /* set below, after the table */
+
+static double f_sin_inv(double x) { return sin(1.0/x); }
+static double f_gauss(double x)   { return exp(-x*x); }
+static double f_runge(double x)   { return 1.0 / (1.0 + 25.0*x*x); }
+static double f_sqrt(double x)    { return sqrt(fabs(x)); }
+static double f_log(double x)     { return x == 0.0 ? 0.0 : log(fabs(x)); }
+static double f_osc(double x)     { return cos(50.0*x) * exp(-x); }
+
+static double f(double x) {
+    return integrand->f(x);
+}
+
+static double simpson(double a, double b, double fa, double fb, double fm) {
+    return (fa + 4.0*fm + fb) * (b - a) / 6.0;
+}
+
+/*
+ * sin(1/x), four at a time: t = 1/x is reduced by q·pi/2 (three-part
+ * pi/2, FMA) to |r| <= pi/4 and the fdlibm sin/cos polynomials are
+ * selected by q mod 4. Within 2 ulp of libm; a vector with any |t| above
+ * SIN_VEC_MAX (or NaN) is done by libm instead.
+ */
+__attribute__((target("avx2,fma")))
+static void sin_inv_batch_avx2(const double *x, double *y, int n) {
+    const __m256d two_over_pi = _mm256_set1_pd(6.36619772367581382433e-01);
+    const __m256d p1 = _mm256_set1_pd(1.57079632679489655800e+00);
+    const __m256d p2 = _mm256_set1_pd(6.12323399573676603587e-17);
+    const __m256d p3 = _mm256_set1_pd(-1.49738490485916983e-33);
+    const __m256d one = _mm256_set1_pd(1.0), half = _mm256_set1_pd(0.5);
+    const __m256d lim = _mm256_set1_pd(SIN_VEC_MAX);
+    const __m256d absmask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+    const __m256i i1 = _mm256_set1_epi64x(1), i2 = _mm256_set1_epi64x(2);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d t = _mm256_div_pd(one, _mm256_loadu_pd(x + i));
+        __m256d ok = _mm256_cmp_pd(_mm256_and_pd(t, absmask), lim, _CMP_LE_OQ);
+        if (_mm256_movemask_pd(ok) != 0xF) {
+            for (int k = 0; k < 4; ++k) y[i + k] = f_sin_inv(x[i + k]);
+            continue;
+        }
+        __m256d q = _mm256_round_pd(_mm256_mul_pd(t, two_over_pi),
+                                    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256d r = _mm256_fnmadd_pd(q, p1, t);
+        r = _mm256_fnmadd_pd(q, p2, r);
+        r = _mm256_fnmadd_pd(q, p3, r);
+        __m256d z = _mm256_mul_pd(r, r);
+
+        __m256d ps = _mm256_fmadd_pd(z, _mm256_set1_pd(1.58969099521155010221e-10),
+                                     _mm256_set1_pd(-2.50507602534068634195e-08));
+        ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(2.75573137070700676789e-06));
+        ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(-1.98412698298579493134e-04));
+        ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(8.33333333332248946124e-03));
+        ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(-1.66666666666666324348e-01));
+        __m256d sn = _mm256_fmadd_pd(_mm256_mul_pd(z, r), ps, r);
+
+        __m256d pc = _mm256_fmadd_pd(z, _mm256_set1_pd(-1.13596475577881948265e-11),
+                                     _mm256_set1_pd(2.08757232129817482790e-09));
+        pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(-2.75573143513906633035e-07));
+        pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(2.48015872894767294178e-05));
+        pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(-1.38888888888741095749e-03));
+        pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(4.16666666666666019037e-02));
+        __m256d cs = _mm256_fmadd_pd(_mm256_mul_pd(z, z), pc, _mm256_fnmadd_pd(half, z, one));
+
+        __m256i qi = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(q));
+        __m256i use_cos = _mm256_cmpeq_epi64(_mm256_and_si256(qi, i1), i1);
+        __m256d res = _mm256_blendv_pd(sn, cs, _mm256_castsi256_pd(use_cos));
+        __m256i sign = _mm256_slli_epi64(_mm256_and_si256(qi, i2), 62);
+        _mm256_storeu_pd(y + i, _mm256_xor_pd(res, _mm256_castsi256_pd(sign)));
+    }
+    for (; i < n; ++i) y[i] = f_sin_inv(x[i]);
+}
+
+static const Integrand integrands[] = {
+    {"sin_inv", "sin(1/x)",          f_sin_inv, sin_inv_batch_avx2},
+    {"gauss",   "exp(-x^2)",         f_gauss,   NULL},
+    {"runge",   "1/(1+25x^2)",       f_runge,   NULL},
+    {"sqrt",    "sqrt(|x|)",         f_sqrt,    NULL},
+    {"log",     "log|x|",            f_log,     NULL},
+    {"osc",     "cos(50x)*exp(-x)",  f_osc,     NULL},
+};
+#define NINTEGRANDS ((int)(sizeof(integrands) / sizeof(integrands[0])))
+
+static const Integrand *integrand = &integrands[0];
+
+/*
+ * Gauss-Kronrod pairs (QUADPACK qk15, qk21). xgk holds the Kronrod
+ * abscissae in decreasing order, the centre last; the odd entries are
+ * the Gauss abscissae, whose weights are in wg.
+ */
+static const double xgk15[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.0,
+};
+static const double wgk15[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714,
+};
+static const double wg7[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327,
+};
+
+static const double xgk21[11] = {
+    0.995657163025808080735527280689003, 0.973906528517171720077964012084452,
+    0.930157491355708226001207180059508, 0.865063366688984510732096688423493,
+    0.780817726586416897063717578345042, 0.679409568299024406234327365114874,
+    0.562757134668604683339000099272694, 0.433395394129247190799265943165784,
+    0.294392862701460198131126603103866, 0.148874338981631210884826001129720,
+    0.0,
+};
+static const double wgk21[11] = {
+    0.011694638867371874278064396062192, 0.032558162307964727478818972459390,
+    0.054755896574351996031381300244580, 0.075039674810919952767043140916190,
+    0.093125454583697605535065465083366, 0.109387158802297641899210590325805,
+    0.123491976262065851077208292238051, 0.134709217311473325928054001771707,
+    0.142775938577060080797094273138717, 0.147739104901338491374841515972068,
+    0.149445554002916905664936468389821,
+};
+static const double wg10[5] = {
+    0.066671344308688137593568809893332, 0.149451349150580593145776339657697,
+    0.219086362515982043995534934228163, 0.269266719309996355091226921569469,
+    0.295524224714752870173892994651338,
+};
+
+typedef struct {
+    const char *name;
+    int nk;               /* Kronrod abscissae incl. centre; 0 for Simpson */
+    const double *xgk, *wgk, *wg;
+    int centre_is_gauss;  /* odd Gauss order */
+    int evals;            /* integrand evaluations per refined piece */
+} Rule;
+
+static const Rule rules[] = {
+    {"simpson", 0,  NULL,  NULL,  NULL, 0, 2},
+    {"gk15",    8,  xgk15, wgk15, wg7,  1, 15},
+    {"gk21",    11, xgk21, wgk21, wg10, 0, 21},
+};
+#define NRULES ((int)(sizeof(rules) / sizeof(rules[0])))
+
+static const Rule *rule = &rules[0];
+
+/* Kronrod estimate of the integral over [a, b]; *err as in QUADPACK. */
+static double gauss_kronrod(const Rule *r, double a, double b, double *err) {
+    double centr = 0.5 * (a + b), hlgth = 0.5 * (b - a);
+    int n = r->nk, ng = n / 2;
+    double fv1[10], fv2[10];
+    double fc = f(centr);
+    double resk = r->wgk[n - 1] * fc;
+    double resg = r->centre_is_gauss ? r->wg[ng - 1] * fc : 0.0;
+    double resabs = fabs(resk);
+    for (int k = 0; k < n - 1; ++k) {
+        double dx = hlgth * r->xgk[k];
+        fv1[k] = f(centr - dx);
+        fv2[k] = f(centr + dx);
+        double fsum = fv1[k] + fv2[k];
+        resk   += r->wgk[k] * fsum;
+        resabs += r->wgk[k] * (fabs(fv1[k]) + fabs(fv2[k]));
+        if (k & 1) resg += r->wg[k / 2] * fsum;
+    }
+    double reskh = 0.5 * resk;
+    double resasc = r->wgk[n - 1] * fabs(fc - reskh);
+    for (int k = 0; k < n - 1; ++k)
+        resasc += r->wgk[k] * (fabs(fv1[k] - reskh) + fabs(fv2[k] - reskh));
+
+    double h = fabs(hlgth);
+    resabs *= h;
+    resasc *= h;
+    double e = fabs((resk - resg) * hlgth);
+    if (resasc != 0.0 && e != 0.0) e = resasc * fmin(1.0, pow(200.0 * e / resasc, 1.5));
+    if (resabs > DBL_MIN / (50.0 * DBL_EPSILON)) e = fmax(50.0 * DBL_EPSILON * resabs, e);
+    *err = e;
+    return resk * hlgth;
+}
+
+/* Evaluates *t with the current rule: 1 and *val if accepted, else 0 and the halves. */
+static int refine(const Task *t, double *val, Task *left, Task *right) {
+    double a = t->a, b = t->b;
+    double m = 0.5 * (a + b);
+    if (rule->nk == 0) {
+        double lm = 0.5 * (a + m), rm = 0.5 * (m + b);
+        double fl = f(lm), fr = f(rm);
+        double Sleft  = simpson(a, m, t->fa, t->fm, fl);
+        double Sright = simpson(m, b, t->fm, t->fb, fr);
+        *val   = Sleft + Sright + (Sleft + Sright - t->S) / 15.0;
+        *left  = (Task){a, m, t->fa, t->fm, fl, Sleft,  t->tol / 2.0};
+        *right = (Task){m, b, t->fm, t->fb, fr, Sright, t->tol / 2.0};
+        /* Pieces whose quarter points collapse (tol has underflowed near a
+           singularity) are accepted instead of bisected forever. */
+        return fabs(Sleft + Sright - t->S) < 15.0 * t->tol
+               || !(a < lm && lm < m && m < rm && rm < b);
+    }
+    double err;
+    *val   = gauss_kronrod(rule, a, b, &err);
+    *left  = (Task){a, m, 0, 0, 0, 0, t->tol / 2.0};
+    *right = (Task){m, b, 0, 0, 0, 0, t->tol / 2.0};
+    return err <= t->tol || !(a < m && m < b);
+}
+
+/* Root task for [a, b]; adds the evaluations it took to *evals. */
+static Task root_task(double a, double b, double eps, long *evals) {
+    if (rule->nk != 0) return (Task){a, b, 0, 0, 0, 0, eps};
+    double fa = f(a), fb = f(b), fm = f(0.5 * (a + b));
+    *evals += 3;
+    return (Task){a, b, fa, fb, fm, simpson(a, b, fa, fb, fm), eps};
+}
+
+/* Integration limits the current integrand accepts. */
+static int quad_domain_ok(double a, double b) {
+    /* sin(1/x) is only integrated away from its essential singularity. */
+    if (integrand->f == f_sin_inv && a <= 0.0) return 0;
+    return a < b;
+}
+
+/*
+ * Handles --f=NAME and --rule=NAME: 1 if arg was one of them, 0 if not,
+ * -1 (after a message on stderr) for an unknown name.
+ */
+static int quad_option(const char *arg) {
+    if (strncmp(arg, "--f=", 4) == 0) {
+        for (int k = 0; k < NINTEGRANDS; ++k)
+            if (strcmp(arg + 4, integrands[k].name) == 0) { integrand = &integrands[k]; return 1; }
+        fprintf(stderr, "Unknown integrand: %s. Available:\n", arg + 4);
+        for (int k = 0; k < NINTEGRANDS; ++k)
+            fprintf(stderr, "    %-8s %s\n", integrands[k].name, integrands[k].expr);
+        return -1;
+    }
+    if (strncmp(arg, "--rule=", 7) == 0) {
+        for (int k = 0; k < NRULES; ++k)
+            if (strcmp(arg + 7, rules[k].name) == 0) { rule = &rules[k]; return 1; }
+        fprintf(stderr, "Unknown rule: %s\n", arg + 7);
+        return -1;
+    }
+    return 0;
+}
+
+#endif /* QUADRATURE_H */
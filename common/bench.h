@@ -0,0 +1,288 @@
+/*
+ * Benchmark harness shared by the programs in this tree.
+ *
+ *   bench_t b;
+ *   bench_init(&b, "seq_sort", &argc, argv);   // takes --reps, --warmup, --bench-out
+ *   bench_config(&b, "N", "%ld", N);
+ *   for (int r = 0; r < bench_runs(&b); ++r) {
+ *       ... untimed setup ...
+ *       double t0 = bench_now();
+ *       ... timed work ...
+ *       bench_record(&b, r, bench_now() - t0);  // warm-up runs are dropped
+ *   }
+ *   printf("... time=%.6f\n", bench_median(&b));
+ *   bench_finish(&b);                           // stats line, output file
+ *
+ * Options removed from argv by bench_init():
+ *   --reps=N         measured repetitions (default 1)
+ *   --warmup=W       unrecorded runs before them (default 0)
+ *   --bench-out=FILE append one record per invocation: FILE ending in
+ *                    .csv gets a row (header written when the file is
+ *                    empty; keep one program/configuration set per file),
+ *                    anything else a JSON object per line with the config,
+ *                    metrics, host metadata and all samples.
+ * With the defaults a program behaves as before: one run, no file.
+ * The statistics use sqrt() and floor(), so programs including this
+ * header link with -lm.
+ *
+ * Statistics: min, max, mean, standard deviation, median, quartiles
+ * (linear interpolation) and IQR, and a distribution-free 95% confidence
+ * interval of the median from order statistics (ranks n/2 -+ 0.98*sqrt(n);
+ * it is the full sample range for n < 6).
+ *
+ * If mpi.h is included first, only rank 0 of b->comm writes and the
+ * communicator size is recorded; callers should record the maximum over
+ * ranks. b->comm is MPI_COMM_WORLD after bench_init(); a program running
+ * several groups at once sets it to the group's communicator. The output
+ * file is locked while a record is appended, so the leaders of concurrent
+ * groups can share it.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/utsname.h>
+
+#define BENCH_MAX_KV 32
+
+typedef struct {
+    const char *name, *out;
+    int reps, warmup;
+    int nconf, nmet;
+    char conf_key[BENCH_MAX_KV][32], conf_val[BENCH_MAX_KV][96];
+    char met_key[BENCH_MAX_KV][32];
+    double met_val[BENCH_MAX_KV];
+    double *samples;
+    int n, cap;
+#ifdef MPI_VERSION
+    MPI_Comm comm;
+#endif
+} bench_t;
+
+typedef struct {
+    int n;
+    double min, max, mean, stddev, median, q1, q3, iqr, ci_lo, ci_hi;
+} bench_stats_t;
+
+static inline double bench_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static inline void bench_init(bench_t *b, const char *name, int *argc, char **argv) {
+    memset(b, 0, sizeof(*b));
+    b->name = name;
+    b->reps = 1;
+#ifdef MPI_VERSION
+    b->comm = MPI_COMM_WORLD;
+#endif
+    int k = 1;
+    for (int i = 1; i < *argc; ++i) {
+        if (strncmp(argv[i], "--reps=", 7) == 0)           b->reps = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--warmup=", 9) == 0)    b->warmup = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--bench-out=", 12) == 0) b->out = argv[i] + 12;
+        else argv[k++] = argv[i];
+    }
+    *argc = k;
+    argv[k] = NULL;
+    if (b->reps < 1) b->reps = 1;
+    if (b->warmup < 0) b->warmup = 0;
+}
+
+static inline int bench_runs(const bench_t *b) {
+    return b->warmup + b->reps;
+}
+
+/* Adds one sample unconditionally (for programs that time many short events). */
+static inline void bench_add(bench_t *b, double seconds) {
+    if (b->n == b->cap) {
+        b->cap = b->cap ? 2 * b->cap : 16;
+        b->samples = realloc(b->samples, b->cap * sizeof(double));
+    }
+    b->samples[b->n++] = seconds;
+}
+
+static inline void bench_record(bench_t *b, int run, double seconds) {
+    if (run >= b->warmup) bench_add(b, seconds);
+}
+
+static inline void bench_config(bench_t *b, const char *key, const char *fmt, ...) {
+    if (b->nconf == BENCH_MAX_KV) return;
+    snprintf(b->conf_key[b->nconf], sizeof(b->conf_key[0]), "%s", key);
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(b->conf_val[b->nconf], sizeof(b->conf_val[0]), fmt, ap);
+    va_end(ap);
+    b->nconf++;
+}
+
+/* A result of the run other than the time (task count, error, ...). */
+static inline void bench_metric(bench_t *b, const char *key, double v) {
+    for (int i = 0; i < b->nmet; ++i)
+        if (strcmp(b->met_key[i], key) == 0) { b->met_val[i] = v; return; }
+    if (b->nmet == BENCH_MAX_KV) return;
+    snprintf(b->met_key[b->nmet], sizeof(b->met_key[0]), "%s", key);
+    b->met_val[b->nmet++] = v;
+}
+
+static int bench_cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static inline double bench_quantile(const double *s, int n, double q) {
+    double pos = q * (n - 1);
+    int i = (int)pos;
+    if (i + 1 >= n) return s[n - 1];
+    return s[i] + (pos - i) * (s[i + 1] - s[i]);
+}
+
+static inline bench_stats_t bench_stats(const bench_t *b) {
+    bench_stats_t st;
+    memset(&st, 0, sizeof(st));
+    int n = st.n = b->n;
+    if (n == 0) return st;
+    double *s = malloc(n * sizeof(double));
+    memcpy(s, b->samples, n * sizeof(double));
+    qsort(s, n, sizeof(double), bench_cmp_double);
+    double sum = 0.0, sq = 0.0;
+    for (int i = 0; i < n; ++i) sum += s[i];
+    st.mean = sum / n;
+    for (int i = 0; i < n; ++i) sq += (s[i] - st.mean) * (s[i] - st.mean);
+    st.stddev = n > 1 ? sqrt(sq / (n - 1)) : 0.0;
+    st.min = s[0];
+    st.max = s[n - 1];
+    st.median = bench_quantile(s, n, 0.5);
+    st.q1 = bench_quantile(s, n, 0.25);
+    st.q3 = bench_quantile(s, n, 0.75);
+    st.iqr = st.q3 - st.q1;
+    int lo = (int)floor(n / 2.0 - 0.98 * sqrt((double)n));
+    int hi = (int)ceil(n / 2.0 + 0.98 * sqrt((double)n));
+    st.ci_lo = s[lo < 0 ? 0 : lo];
+    st.ci_hi = s[hi > n - 1 ? n - 1 : hi];
+    free(s);
+    return st;
+}
+
+static inline double bench_median(const bench_t *b) {
+    return bench_stats(b).median;
+}
+
+static inline void bench_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static inline int bench_write(const bench_t *b) {
+    if (!b->out) return 0;
+    int ranks = 1;
+#ifdef MPI_VERSION
+    int rank;
+    MPI_Comm_rank(b->comm, &rank);
+    MPI_Comm_size(b->comm, &ranks);
+    if (rank != 0) return 0;
+#endif
+    FILE *f = fopen(b->out, "a");
+    if (!f) { perror(b->out); return -1; }
+    flock(fileno(f), LOCK_EX);
+    bench_stats_t st = bench_stats(b);
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    struct utsname u;
+    if (uname(&u) != 0) memset(&u, 0, sizeof(u));
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    const char *names[] = {"min", "median", "mean", "stddev", "q1", "q3", "iqr", "ci_lo", "ci_hi", "max"};
+    double vals[] = {st.min, st.median, st.mean, st.stddev, st.q1, st.q3, st.iqr, st.ci_lo, st.ci_hi, st.max};
+    int nstat = (int)(sizeof(vals) / sizeof(vals[0]));
+
+    size_t len = strlen(b->out);
+    if (len >= 4 && strcmp(b->out + len - 4, ".csv") == 0) {
+        fseek(f, 0, SEEK_END);
+        if (ftell(f) == 0) {
+            fprintf(f, "name");
+            for (int i = 0; i < b->nconf; ++i) fprintf(f, ",%s", b->conf_key[i]);
+            fprintf(f, ",ranks,reps,warmup");
+            for (int i = 0; i < nstat; ++i) fprintf(f, ",%s", names[i]);
+            for (int i = 0; i < b->nmet; ++i) fprintf(f, ",%s", b->met_key[i]);
+            fprintf(f, ",host,ncpu,timestamp\n");
+        }
+        fprintf(f, "%s", b->name);
+        for (int i = 0; i < b->nconf; ++i) fprintf(f, ",%s", b->conf_val[i]);
+        fprintf(f, ",%d,%d,%d", ranks, st.n, b->warmup);
+        for (int i = 0; i < nstat; ++i) fprintf(f, ",%.9g", vals[i]);
+        for (int i = 0; i < b->nmet; ++i) fprintf(f, ",%.10g", b->met_val[i]);
+        fprintf(f, ",%s,%ld,%s\n", host, ncpu, stamp);
+    } else {
+        fprintf(f, "{\"name\":");
+        bench_json_string(f, b->name);
+        fprintf(f, ",\"config\":{");
+        for (int i = 0; i < b->nconf; ++i) {
+            if (i) fputc(',', f);
+            bench_json_string(f, b->conf_key[i]);
+            fputc(':', f);
+            bench_json_string(f, b->conf_val[i]);
+        }
+        fprintf(f, "},\"metrics\":{");
+        for (int i = 0; i < b->nmet; ++i) {
+            if (i) fputc(',', f);
+            bench_json_string(f, b->met_key[i]);
+            fprintf(f, ":%.10g", b->met_val[i]);
+        }
+        fprintf(f, "},\"stats\":{\"reps\":%d,\"warmup\":%d", st.n, b->warmup);
+        for (int i = 0; i < nstat; ++i) fprintf(f, ",\"%s\":%.9g", names[i], vals[i]);
+        fprintf(f, "},\"samples\":[");
+        for (int i = 0; i < b->n; ++i) fprintf(f, "%s%.9g", i ? "," : "", b->samples[i]);
+        fprintf(f, "],\"host\":{\"hostname\":");
+        bench_json_string(f, host);
+        fprintf(f, ",\"sysname\":");
+        bench_json_string(f, u.sysname);
+        fprintf(f, ",\"release\":");
+        bench_json_string(f, u.release);
+        fprintf(f, ",\"machine\":");
+        bench_json_string(f, u.machine);
+#ifdef __VERSION__
+        fprintf(f, ",\"compiler\":");
+        bench_json_string(f, __VERSION__);
+#endif
+        fprintf(f, ",\"ncpu\":%ld,\"ranks\":%d},\"timestamp\":\"%s\"}\n", ncpu, ranks, stamp);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Prints a summary line when more than one repetition was measured, writes the output file and frees the samples. */
+static inline int bench_finish(bench_t *b) {
+    int rank = 0;
+#ifdef MPI_VERSION
+    MPI_Comm_rank(b->comm, &rank);
+#endif
+    if (rank == 0 && b->n > 1) {
+        bench_stats_t st = bench_stats(b);
+        printf("bench %s reps=%d warmup=%d median=%.6g iqr=%.3g ci95=[%.6g,%.6g] min=%.6g max=%.6g\n",
+               b->name, st.n, b->warmup, st.median, st.iqr, st.ci_lo, st.ci_hi, st.min, st.max);
+    }
+    int rc = bench_write(b);
+    free(b->samples);
+    b->samples = NULL;
+    b->n = b->cap = 0;
+    return rc;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,273 @@
+/*
+ * Named hardware-counter regions on Linux perf_event_open.
+ *
+ * Compiled in only with -DPERF_REGIONS; otherwise every macro below
+ * expands to nothing, so instrumented code is identical to the original.
+ *
+ *   enum { R_SORT, R_MERGE, NREGIONS };
+ *   static const char *region_names[NREGIONS] = {"sort", "merge"};
+ *
+ *   PERF_THREAD(tid);                  // optional: fix this thread's slot
+ *   PERF_BEGIN(R_SORT); ... PERF_END(R_SORT);
+ *   PERF_COMM(comm);                   // MPI only, optional: report over comm
+ *   PERF_REPORT(region_names, NREGIONS);
+ *
+ * Every thread opens its own counter group (user-space cycles,
+ * instructions, last-level cache misses, branch misses) on its first
+ * PERF_BEGIN and adds the counts and the wall time between BEGIN and END
+ * of the same region to its slot. PERF_THREAD(i) puts the calling thread
+ * in slot i (the slot keeps its totals when a later thread takes it, as
+ * when a pool is recreated for every repetition); without it threads get
+ * slots in order of first use; a slot must be used by one thread at a
+ * time. Regions of different ids may nest.
+ *
+ * PERF_REPORT prints one line per slot and a total per region: calls,
+ * time, counts, IPC, LLC misses per kilo-instruction, and the bandwidth
+ * the LLC misses imply (64 bytes each over the slowest slot's time), and
+ * clears the totals, so consecutive reports cover disjoint runs. If
+ * mpi.h is included first, the slots of each rank are summed, rank 0
+ * prints one line per rank and the total over ranks; it is collective
+ * over MPI_COMM_WORLD, or over the communicator last given to PERF_COMM(c).
+ * Events the kernel refuses (virtual machines, perf_event_paranoid > 2)
+ * are shown as "-"; times are still measured.
+ *
+ * Each BEGIN/END costs a read() of the group (about a microsecond), so
+ * regions should cover much more work than that.
+ */
+
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#ifdef PERF_REGIONS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define PERF_MAX_REGIONS 16
+#define PERF_MAX_THREADS 256
+#define PERF_NEV         4
+#define PERF_LINE_BYTES  64
+
+static const uint64_t perf_event_config[PERF_NEV] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+typedef struct {
+    double time;
+    double calls;
+    double ev[PERF_NEV];
+} perf_acc_t;
+
+typedef struct {
+    int leader;
+    int pos[PERF_NEV];                  /* position in the group read, -1 if not open */
+    int fd[PERF_NEV];
+    uint64_t start[PERF_MAX_REGIONS][PERF_NEV];
+    double t0[PERF_MAX_REGIONS];
+    perf_acc_t acc[PERF_MAX_REGIONS];
+} perf_thread_t;
+
+static perf_thread_t *perf_slots[PERF_MAX_THREADS];
+static atomic_int perf_next_slot;
+static atomic_int perf_avail;           /* bit e: event e opened somewhere */
+static __thread perf_thread_t *perf_self;
+#ifdef MPI_VERSION
+static int perf_comm_set;
+static MPI_Comm perf_comm;
+#endif
+
+static inline double perf_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void perf_open(perf_thread_t *p) {
+    p->leader = -1;
+    int n = 0;
+    for (int e = 0; e < PERF_NEV; ++e) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = perf_event_config[e];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = p->leader < 0;
+        p->fd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, p->leader, 0);
+        p->pos[e] = p->fd[e] >= 0 ? n++ : -1;
+        if (p->fd[e] < 0) continue;
+        if (p->leader < 0) p->leader = p->fd[e];
+        atomic_fetch_or(&perf_avail, 1 << e);
+    }
+    if (p->leader >= 0) ioctl(p->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static void perf_close(perf_thread_t *p) {
+    for (int e = PERF_NEV - 1; e >= 0; --e)
+        if (p->fd[e] >= 0) close(p->fd[e]);
+}
+
+/* Binds the calling thread to slot i, opening counters for it. */
+static void perf_thread(int i) {
+    if (i < 0 || i >= PERF_MAX_THREADS) return;
+    perf_thread_t *p = perf_slots[i];
+    if (!p) {
+        p = calloc(1, sizeof(*p));
+        if (!p) return;
+        perf_slots[i] = p;
+        int n = atomic_load(&perf_next_slot);
+        while (n <= i && !atomic_compare_exchange_weak(&perf_next_slot, &n, i + 1)) {}
+    } else {
+        perf_close(p);
+    }
+    perf_open(p);
+    perf_self = p;
+}
+
+static inline void perf_read(const perf_thread_t *p, uint64_t *v) {
+    uint64_t buf[1 + PERF_NEV];
+    memset(v, 0, PERF_NEV * sizeof(uint64_t));
+    if (p->leader < 0 || read(p->leader, buf, sizeof(buf)) <= 0) return;
+    for (int e = 0; e < PERF_NEV; ++e)
+        if (p->pos[e] >= 0 && (uint64_t)p->pos[e] < buf[0]) v[e] = buf[1 + p->pos[e]];
+}
+
+static inline void perf_begin(int r) {
+    if (!perf_self) perf_thread(atomic_load(&perf_next_slot));
+    perf_thread_t *p = perf_self;
+    if (!p) return;
+    perf_read(p, p->start[r]);
+    p->t0[r] = perf_now();
+}
+
+static inline void perf_end(int r) {
+    perf_thread_t *p = perf_self;
+    if (!p) return;
+    double t = perf_now();
+    uint64_t v[PERF_NEV];
+    perf_read(p, v);
+    perf_acc_t *a = &p->acc[r];
+    a->time += t - p->t0[r];
+    a->calls += 1;
+    for (int e = 0; e < PERF_NEV; ++e) a->ev[e] += (double)(v[e] - p->start[r][e]);
+}
+
+static void perf_print_head(void) {
+    printf("perf %-12s %-6s %10s %10s %12s %12s %5s %10s %6s %10s %8s\n",
+           "region", "who", "calls", "time_s", "cycles", "instr", "IPC",
+           "llc_miss", "MPKI", "br_miss", "llc_GBps");
+}
+
+static void perf_print_line(const char *name, const char *who, const perf_acc_t *a,
+                            double tmax, int avail) {
+    char f[PERF_NEV][24];
+    for (int e = 0; e < PERF_NEV; ++e) {
+        if (avail & (1 << e)) snprintf(f[e], sizeof(f[e]), "%.0f", a->ev[e]);
+        else snprintf(f[e], sizeof(f[e]), "-");
+    }
+    char ipc[16] = "-", mpki[16] = "-", bw[16] = "-";
+    if ((avail & 3) == 3 && a->ev[0] > 0) snprintf(ipc, sizeof(ipc), "%.2f", a->ev[1] / a->ev[0]);
+    if ((avail & 6) == 6 && a->ev[1] > 0) snprintf(mpki, sizeof(mpki), "%.2f", 1e3 * a->ev[2] / a->ev[1]);
+    if ((avail & 4) && tmax > 0) snprintf(bw, sizeof(bw), "%.2f", a->ev[2] * PERF_LINE_BYTES / tmax * 1e-9);
+    printf("perf %-12s %-6s %10.0f %10.6f %12s %12s %5s %10s %6s %10s %8s\n",
+           name, who, a->calls, a->time, f[0], f[1], ipc, f[2], mpki, f[3], bw);
+}
+
+static void perf_sum(perf_acc_t *dst, const perf_acc_t *src) {
+    dst->time += src->time;
+    dst->calls += src->calls;
+    for (int e = 0; e < PERF_NEV; ++e) dst->ev[e] += src->ev[e];
+}
+
+static void perf_clear(int nslots) {
+    for (int s = 0; s < nslots; ++s)
+        if (perf_slots[s]) memset(perf_slots[s]->acc, 0, sizeof(perf_slots[s]->acc));
+}
+
+static void perf_report(const char *const *names, int nregions) {
+    if (nregions > PERF_MAX_REGIONS) nregions = PERF_MAX_REGIONS;
+    int nslots = atomic_load(&perf_next_slot);
+    if (nslots > PERF_MAX_THREADS) nslots = PERF_MAX_THREADS;
+    int avail = atomic_load(&perf_avail);
+#ifdef MPI_VERSION
+    /* Slots summed per rank; the rank is the unit of the report. */
+    MPI_Comm comm = perf_comm_set ? perf_comm : MPI_COMM_WORLD;
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    perf_acc_t mine[PERF_MAX_REGIONS];
+    memset(mine, 0, sizeof(mine));
+    for (int s = 0; s < nslots; ++s)
+        if (perf_slots[s])
+            for (int r = 0; r < nregions; ++r) perf_sum(&mine[r], &perf_slots[s]->acc[r]);
+    perf_clear(nslots);
+    int per = nregions * (int)(sizeof(perf_acc_t) / sizeof(double));
+    perf_acc_t *all = rank == 0 ? malloc((size_t)size * nregions * sizeof(perf_acc_t)) : NULL;
+    MPI_Gather(mine, per, MPI_DOUBLE, all, per, MPI_DOUBLE, 0, comm);
+    int any;
+    MPI_Reduce(&avail, &any, 1, MPI_INT, MPI_BOR, 0, comm);
+    if (rank != 0) return;
+    avail = any;
+    int nunits = size;
+    const char *unit = "rank";
+#else
+    int nunits = nslots;
+    const char *unit = "thread";
+    perf_acc_t *all = calloc((size_t)(nunits ? nunits : 1) * nregions, sizeof(perf_acc_t));
+    for (int s = 0; s < nslots; ++s)
+        if (perf_slots[s]) memcpy(&all[s * nregions], perf_slots[s]->acc, nregions * sizeof(perf_acc_t));
+    perf_clear(nslots);
+#endif
+    if (!all) return;
+    if (!avail) printf("perf: hardware counters unavailable, times only\n");
+    perf_print_head();
+    for (int r = 0; r < nregions; ++r) {
+        perf_acc_t total;
+        memset(&total, 0, sizeof(total));
+        double tmax = 0.0;
+        for (int u = 0; u < nunits; ++u) {
+            const perf_acc_t *a = &all[u * nregions + r];
+            if (a->calls == 0) continue;
+            char who[16];
+            snprintf(who, sizeof(who), "%c%d", unit[0], u);
+            perf_print_line(names[r], who, a, a->time, avail);
+            perf_sum(&total, a);
+            if (a->time > tmax) tmax = a->time;
+        }
+        if (total.calls > 0) perf_print_line(names[r], "total", &total, tmax, avail);
+    }
+    free(all);
+}
+
+#define PERF_THREAD(i)          perf_thread(i)
+#define PERF_BEGIN(r)           perf_begin(r)
+#define PERF_END(r)             perf_end(r)
+#define PERF_REPORT(names, n)   perf_report(names, n)
+#ifdef MPI_VERSION
+#define PERF_COMM(c)            (perf_comm = (c), perf_comm_set = 1)
+#else
+#define PERF_COMM(c)            ((void)0)
+#endif
+
+#else
+
+#define PERF_THREAD(i)          ((void)0)
+#define PERF_BEGIN(r)           ((void)0)
+#define PERF_END(r)             ((void)0)
+#define PERF_REPORT(names, n)   ((void)(names), (void)(n))
+#define PERF_COMM(c)            ((void)0)
+
+#endif /* PERF_REGIONS */
+
+#endif /* PERFCTR_H */
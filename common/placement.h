@@ -0,0 +1,302 @@
+/*
+ * Thread placement and large-buffer allocation for the pthread programs.
+ *
+ *   place_t pl;
+ *   if (place_init(&pl, &argc, argv) != 0) ...   // takes --bind, --hugepages
+ *   int *a = place_alloc(&pl, bytes);            // huge pages if requested
+ *   place_touch(&pl, a, bytes, P);               // slice t touched by thread t
+ *   ... in worker t:  place_bind(&pl, t);
+ *   place_unbind(&pl);                           // main thread, if it was a worker
+ *   place_free(&pl, a, bytes);
+ *
+ * Options removed from argv by place_init():
+ *   --bind=none|compact|scatter|core
+ *       none     threads are left to the scheduler (default, as before)
+ *       compact  worker t on the t-th hardware thread, the SMT siblings of
+ *                a core first, then the next core, node by node
+ *       scatter  round robin over NUMA nodes, one worker per core of each
+ *                node before any SMT sibling is used
+ *       core     one worker per physical core in node order; SMT siblings
+ *                only once every core has a worker
+ *     With more workers than CPUs the order wraps around.
+ *   --hugepages=off|thp|explicit
+ *       thp      2 MiB aligned anonymous mapping with MADV_HUGEPAGE
+ *       explicit MAP_HUGETLB from the reserved pool (vm.nr_hugepages),
+ *                falling back to thp when the pool is too small
+ *     Only buffers of at least one huge page are affected.
+ *
+ * The topology is read from /sys/devices/system/cpu/cpuN/topology and the
+ * cpuN/nodeM links, restricted to the CPUs the process may run on, so an
+ * outer taskset or numactl is respected. Elsewhere (macOS) --bind has no
+ * effect and huge pages fall back to malloc.
+ *
+ * place_touch() zeroes slice t = [bytes*t/P, bytes*(t+1)/P) from a thread
+ * bound like worker t: with first-touch page placement each worker's part
+ * of the buffer then sits on its own node, provided worker t is given the
+ * matching part of the data.
+ */
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define PLACE_MAX_CPUS 1024
+#define PLACE_HUGE     (2ul << 20)
+
+enum { PLACE_NONE, PLACE_COMPACT, PLACE_SCATTER, PLACE_CORE };
+enum { PLACE_HUGE_OFF, PLACE_HUGE_THP, PLACE_HUGE_EXPLICIT };
+
+static const char *place_policy_names[] = {"none", "compact", "scatter", "core"};
+static const char *place_huge_names[]   = {"off", "thp", "explicit"};
+
+typedef struct {
+    int policy, huge;
+    int ncpu;                   /* CPUs available, in placement order */
+    int cpu[PLACE_MAX_CPUS];
+} place_t;
+
+typedef struct {
+    int cpu, key[4];
+} place_hw_t;
+
+static inline int place_name(const char *s, const char *const *names, int n) {
+    for (int i = 0; i < n; ++i)
+        if (strcmp(s, names[i]) == 0) return i;
+    return -1;
+}
+
+static inline int place_read_int(const char *fmt, int cpu, int dflt) {
+    char path[128];
+    snprintf(path, sizeof(path), fmt, cpu);
+    FILE *f = fopen(path, "r");
+    int v = dflt;
+    if (f) {
+        if (fscanf(f, "%d", &v) != 1) v = dflt;
+        fclose(f);
+    }
+    return v;
+}
+
+static inline int place_node_of(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *d = opendir(path);
+    if (!d) return 0;
+    int node = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (strncmp(e->d_name, "node", 4) == 0 && isdigit((unsigned char)e->d_name[4])) {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+static inline int place_cmp_hw(const void *a, const void *b) {
+    const place_hw_t *x = a, *y = b;
+    for (int i = 0; i < 4; ++i)
+        if (x->key[i] != y->key[i]) return (x->key[i] > y->key[i]) - (x->key[i] < y->key[i]);
+    return (x->cpu > y->cpu) - (x->cpu < y->cpu);
+}
+
+/* Fills pl->cpu with the allowed CPUs in the order of pl->policy. */
+static inline void place_topology(place_t *pl) {
+    pl->ncpu = 0;
+#ifdef __linux__
+    unsigned long mask[PLACE_MAX_CPUS / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    if (syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask) < 0) return;
+    static place_hw_t hw[PLACE_MAX_CPUS];
+    int pkg[PLACE_MAX_CPUS], core[PLACE_MAX_CPUS], node[PLACE_MAX_CPUS], smt[PLACE_MAX_CPUS];
+    int n = 0;
+    for (int c = 0; c < PLACE_MAX_CPUS; ++c) {
+        if (!(mask[c / (8 * sizeof(unsigned long))] >> (c % (8 * sizeof(unsigned long))) & 1)) continue;
+        hw[n].cpu = c;
+        pkg[n]  = place_read_int("/sys/devices/system/cpu/cpu%d/topology/physical_package_id", c, 0);
+        core[n] = place_read_int("/sys/devices/system/cpu/cpu%d/topology/core_id", c, c);
+        node[n] = place_node_of(c);
+        smt[n] = 0;
+        for (int j = 0; j < n; ++j)
+            if (pkg[j] == pkg[n] && core[j] == core[n]) smt[n]++;
+        ++n;
+    }
+    for (int i = 0; i < n; ++i) {
+        int *k = hw[i].key;
+        if (pl->policy == PLACE_COMPACT) {
+            k[0] = node[i]; k[1] = pkg[i]; k[2] = core[i]; k[3] = smt[i];
+        } else if (pl->policy == PLACE_CORE) {
+            k[0] = smt[i]; k[1] = node[i]; k[2] = pkg[i]; k[3] = core[i];
+        } else {
+            /* Scatter: the rank of the core within its node decides first. */
+            int rank = 0;
+            for (int j = 0; j < n; ++j)
+                if (node[j] == node[i] && smt[j] == smt[i] &&
+                    (pkg[j] < pkg[i] || (pkg[j] == pkg[i] && core[j] < core[i]))) rank++;
+            k[0] = smt[i]; k[1] = rank; k[2] = node[i]; k[3] = pkg[i];
+        }
+    }
+    qsort(hw, n, sizeof(hw[0]), place_cmp_hw);
+    for (int i = 0; i < n; ++i) pl->cpu[i] = hw[i].cpu;
+    pl->ncpu = n;
+#endif
+}
+
+/* Returns 0, or -1 (after a message) for an unknown option value. */
+static inline int place_init(place_t *pl, int *argc, char **argv) {
+    memset(pl, 0, sizeof(*pl));
+    int k = 1, rc = 0;
+    for (int i = 1; i < *argc; ++i) {
+        if (strncmp(argv[i], "--bind=", 7) == 0) {
+            pl->policy = place_name(argv[i] + 7, place_policy_names, 4);
+            if (pl->policy < 0) {
+                fprintf(stderr, "unknown binding: %s (none|compact|scatter|core)\n", argv[i] + 7);
+                rc = -1;
+            }
+        } else if (strncmp(argv[i], "--hugepages=", 12) == 0) {
+            pl->huge = place_name(argv[i] + 12, place_huge_names, 3);
+            if (pl->huge < 0) {
+                fprintf(stderr, "unknown huge page mode: %s (off|thp|explicit)\n", argv[i] + 12);
+                rc = -1;
+            }
+        } else {
+            argv[k++] = argv[i];
+        }
+    }
+    *argc = k;
+    argv[k] = NULL;
+    if (rc != 0) return rc;
+    if (pl->policy != PLACE_NONE) place_topology(pl);
+    return 0;
+}
+
+/* CPU of worker t, or -1 if it is not bound. */
+static inline int place_cpu(const place_t *pl, int t) {
+    if (pl->policy == PLACE_NONE || pl->ncpu == 0) return -1;
+    return pl->cpu[t % pl->ncpu];
+}
+
+/* Binds the calling thread as worker t. */
+static inline void place_bind(const place_t *pl, int t) {
+    int cpu = place_cpu(pl, t);
+    if (cpu < 0) return;
+#ifdef __linux__
+    unsigned long mask[PLACE_MAX_CPUS / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    mask[cpu / (8 * sizeof(unsigned long))] |= 1ul << (cpu % (8 * sizeof(unsigned long)));
+    syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+#endif
+}
+
+/*
+ * Lets the calling thread run on all the CPUs again, for a main thread
+ * that served as a worker: threads it creates inherit its mask.
+ */
+static inline void place_unbind(const place_t *pl) {
+    if (place_cpu(pl, 0) < 0) return;
+#ifdef __linux__
+    unsigned long mask[PLACE_MAX_CPUS / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    for (int i = 0; i < pl->ncpu; ++i)
+        mask[pl->cpu[i] / (8 * sizeof(unsigned long))] |= 1ul << (pl->cpu[i] % (8 * sizeof(unsigned long)));
+    syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+#endif
+}
+
+/* One line with the options and the CPUs of the first nthreads workers; nothing with the defaults. */
+static inline void place_print(const place_t *pl, int nthreads) {
+    if (pl->policy == PLACE_NONE && pl->huge == PLACE_HUGE_OFF) return;
+    printf("placement bind=%s hugepages=%s", place_policy_names[pl->policy], place_huge_names[pl->huge]);
+    if (pl->policy != PLACE_NONE) {
+        if (pl->ncpu == 0) printf(" (no topology, threads unbound)");
+        else
+            for (int t = 0; t < nthreads; ++t) printf("%s%d", t ? "," : " cpus=", place_cpu(pl, t));
+    }
+    printf("\n");
+}
+
+static inline int place_is_huge(const place_t *pl, size_t bytes) {
+#ifdef __linux__
+    return pl->huge != PLACE_HUGE_OFF && bytes >= PLACE_HUGE;
+#else
+    (void)pl; (void)bytes;
+    return 0;
+#endif
+}
+
+/* Like malloc; release with place_free() and the same size. */
+static inline void *place_alloc(const place_t *pl, size_t bytes) {
+    if (!place_is_huge(pl, bytes)) return malloc(bytes);
+#ifdef __linux__
+    size_t len = (bytes + PLACE_HUGE - 1) & ~(PLACE_HUGE - 1);
+    if (pl->huge == PLACE_HUGE_EXPLICIT) {
+        void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) return p;
+        static int noted = 0;
+        if (!noted) fprintf(stderr, "hugepages=explicit: pool too small, using thp\n");
+        noted = 1;
+    }
+    /* Over-allocate by one huge page and trim to a 2 MiB aligned range. */
+    char *raw = mmap(NULL, len + PLACE_HUGE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    char *p = (char *)(((uintptr_t)raw + PLACE_HUGE - 1) & ~(uintptr_t)(PLACE_HUGE - 1));
+    if (p > raw) munmap(raw, p - raw);
+    if (p + len < raw + len + PLACE_HUGE) munmap(p + len, raw + len + PLACE_HUGE - (p + len));
+#ifdef MADV_HUGEPAGE
+    madvise(p, len, MADV_HUGEPAGE);
+#endif
+    return p;
+#else
+    return malloc(bytes);
+#endif
+}
+
+static inline void place_free(const place_t *pl, void *p, size_t bytes) {
+    if (!p) return;
+    if (!place_is_huge(pl, bytes)) { free(p); return; }
+    munmap(p, (bytes + PLACE_HUGE - 1) & ~(PLACE_HUGE - 1));
+}
+
+struct place_touch_args {
+    const place_t *pl;
+    char *p;
+    size_t lo, hi;
+    int t;
+};
+
+static inline void *place_touch_thread(void *arg) {
+    struct place_touch_args *a = arg;
+    place_bind(a->pl, a->t);
+    memset(a->p + a->lo, 0, a->hi - a->lo);
+    return NULL;
+}
+
+static inline void place_touch(const place_t *pl, void *p, size_t bytes, int nthreads) {
+    if (!p || nthreads < 1) return;
+    pthread_t *th = malloc(nthreads * sizeof(pthread_t));
+    struct place_touch_args *a = malloc(nthreads * sizeof(*a));
+    for (int t = 0; t < nthreads; ++t) {
+        a[t] = (struct place_touch_args){pl, p, bytes * t / nthreads, bytes * (t + 1) / nthreads, t};
+        pthread_create(&th[t], NULL, place_touch_thread, &a[t]);
+    }
+    for (int t = 0; t < nthreads; ++t) pthread_join(th[t], NULL);
+    free(th);
+    free(a);
+}
+
+#endif /* PLACEMENT_H */
@@ -0,0 +1,152 @@
+/*
+ * Reproducible summation of doubles.
+ *
+ * reprosum_t is an exact fixed-point accumulator (a "superaccumulator")
+ * covering the whole double range: the value is sum(chunk[i] * 2^(32*i -
+ * 1074)) with 64-bit signed chunks that each receive 32-bit pieces. Adding
+ * a double splits its 53-bit significand over at most three chunks, with
+ * no rounding. Merging two accumulators adds the chunks. Both operations
+ * are exact, so the final value depends only on the set of terms, not on
+ * their order or grouping, and reprosum_value() is bitwise identical for
+ * any thread/rank count.
+ *
+ * Depositing every term costs ~10x a plain add. Producers that generate
+ * many terms in a fixed order (e.g. over a global index range) should sum
+ * fixed-size blocks with an ordinary, vectorized loop and deposit only
+ * the block sums: the block boundaries do not depend on the decomposition,
+ * so the result stays reproducible and the overhead is amortized.
+ *
+ * If mpi.h is included before this header, reprosum_mpi_init() creates a
+ * datatype and a commutative MPI_Op for MPI_Reduce/MPI_Allreduce.
+ */
+
+#ifndef REPROSUM_H
+#define REPROSUM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define REPROSUM_NCHUNKS 68          /* 2098 bits of range + carry headroom */
+#define REPROSUM_EMIN    (-1074)     /* weight of bit 0 of chunk 0 */
+#define REPROSUM_MAX_PENDING (1 << 30)
+
+typedef struct {
+    int64_t chunk[REPROSUM_NCHUNKS];
+    int32_t pending;   /* deposits since the last normalization */
+    int32_t special;   /* bit 0: +inf, bit 1: -inf, bit 2: nan */
+} reprosum_t;
+
+static inline void reprosum_init(reprosum_t *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+/* Carries so that chunks 0..N-2 lie in [0, 2^32); the top chunk keeps the sign. */
+static inline void reprosum_normalize(reprosum_t *s) {
+    for (int i = 0; i < REPROSUM_NCHUNKS - 1; ++i) {
+        int64_t c = s->chunk[i] >> 32;   /* arithmetic shift: floor division */
+        s->chunk[i] -= c * ((int64_t)1 << 32);
+        s->chunk[i + 1] += c;
+    }
+    s->pending = 0;
+}
+
+static inline void reprosum_add(reprosum_t *s, double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int neg = (int)(bits >> 63);
+    int e = (int)((bits >> 52) & 0x7FF);
+    uint64_t m = bits & ((UINT64_C(1) << 52) - 1);
+    if (e == 0x7FF) {
+        s->special |= m ? 4 : (neg ? 2 : 1);
+        return;
+    }
+    if (e == 0) {
+        if (m == 0) return;
+        e = 1;                           /* subnormal: same weight as e = 1 */
+    } else {
+        m |= UINT64_C(1) << 52;
+    }
+    int p = e - 1;                       /* bit position of m's bit 0 above 2^-1074 */
+    int idx = p >> 5, sh = p & 31;
+    int64_t lo  = (int64_t)((m << sh) & 0xFFFFFFFFu);
+    int64_t mid = (int64_t)((m >> (32 - sh)) & 0xFFFFFFFFu);
+    int64_t hi  = sh ? (int64_t)(m >> (64 - sh)) : 0;
+    if (neg) {
+        s->chunk[idx]     -= lo;
+        s->chunk[idx + 1] -= mid;
+        s->chunk[idx + 2] -= hi;
+    } else {
+        s->chunk[idx]     += lo;
+        s->chunk[idx + 1] += mid;
+        s->chunk[idx + 2] += hi;
+    }
+    if (++s->pending == REPROSUM_MAX_PENDING) reprosum_normalize(s);
+}
+
+/* s += t (exact). */
+static inline void reprosum_merge(reprosum_t *s, const reprosum_t *t) {
+    reprosum_t tn = *t;
+    if (tn.pending) reprosum_normalize(&tn);
+    if (s->pending) reprosum_normalize(s);
+    for (int i = 0; i < REPROSUM_NCHUNKS; ++i) s->chunk[i] += tn.chunk[i];
+    s->special |= tn.special;
+    s->pending = 1;
+}
+
+/*
+ * Rounds the exact sum to the nearest double: the leading 64 bits of the
+ * magnitude with a sticky bit for everything below are converted in one
+ * correctly rounded step (results in the subnormal range may be rounded
+ * twice).
+ */
+static inline double reprosum_value(const reprosum_t *src) {
+    if (src->special & 4) return NAN;
+    if ((src->special & 3) == 3) return NAN;
+    if (src->special & 1) return INFINITY;
+    if (src->special & 2) return -INFINITY;
+
+    reprosum_t s = *src;
+    reprosum_normalize(&s);
+    double sign = 1.0;
+    if (s.chunk[REPROSUM_NCHUNKS - 1] < 0) {
+        for (int i = 0; i < REPROSUM_NCHUNKS; ++i) s.chunk[i] = -s.chunk[i];
+        reprosum_normalize(&s);
+        sign = -1.0;
+    }
+    int k = REPROSUM_NCHUNKS - 1;
+    while (k >= 0 && s.chunk[k] == 0) --k;
+    if (k < 0) return 0.0;
+    uint64_t top = (uint64_t)s.chunk[k] << 32;
+    if (k >= 1) top |= (uint64_t)s.chunk[k - 1];
+    uint64_t low = k >= 2 ? (uint64_t)s.chunk[k - 2] : 0;
+    int lz = __builtin_clzll(top);
+    uint64_t mant = top << lz;
+    uint64_t rest = low;
+    if (lz > 0) {
+        mant |= low >> (32 - lz);
+        rest = (low << (32 + lz)) >> (32 + lz);
+    }
+    int sticky = (rest != 0);
+    for (int i = k - 3; i >= 0 && !sticky; --i) sticky = (s.chunk[i] != 0);
+    mant |= (uint64_t)sticky;
+    return sign * ldexp((double)mant, 32 * (k - 1) + REPROSUM_EMIN - lz);
+}
+
+#ifdef MPI_VERSION
+static void reprosum_mpi_sum(void *in, void *inout, int *len, MPI_Datatype *dt) {
+    (void)dt;
+    const reprosum_t *a = in;
+    reprosum_t *b = inout;
+    for (int i = 0; i < *len; ++i) reprosum_merge(&b[i], &a[i]);
+}
+
+/* Datatype and MPI_Op for reprosum_t; free with MPI_Type_free / MPI_Op_free. */
+static inline void reprosum_mpi_init(MPI_Datatype *type, MPI_Op *op) {
+    MPI_Type_contiguous((int)sizeof(reprosum_t), MPI_BYTE, type);
+    MPI_Type_commit(type);
+    MPI_Op_create(reprosum_mpi_sum, 1, op);
+}
+#endif
+
+#endif /* REPROSUM_H */